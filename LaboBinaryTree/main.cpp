@@ -11,878 +11,6222 @@
 #include <queue>
 #include <cassert>
 #include <stdexcept>
+#include <array>
+#include <algorithm>
+#include <new>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#ifdef BST_LIBNUMA
+#include <numa.h>
+#include <sched.h>
+#endif
 
 using namespace std;
 
-template <typename T>
-class BinarySearchTree 
+//
+// @brief Operations distinguees par les politiques de statistiques
+//
+// Other recoit ce qui est fait hors d'une operation instrumentee, par
+// exemple la destruction de l'arbre.
+//
+enum class TreeOp { Insert, Contains, DeleteElement, DeleteMin, Min, Rank, 
+                    NthElement, Quantile, Balance, Linearize, Copy, Other, 
+                    Count };
+
+inline const char* name(TreeOp op)
 {
-public:
-  
-  using value_type = T;
-  using reference = T&;
-  using const_reference = const T&;
+  static const char* names[] = { "insert", "contains", "deleteElement", 
+    "deleteMin", "min", "rank", "nth_element", "quantile", "balance", 
+    "linearize", "copy", "other" };
+  return names[size_t(op)];
+}
 
-private:
-  /**
-   *  @brief Noeud de l'arbre.
-   *
-   * contient une cle et les liens vers les sous-arbres droit et gauche.
-   */
-  struct Node 
+//
+// @brief Politique de statistiques par defaut : ne compte rien.
+//
+// Toutes ses fonctions sont vides, l'instrumentation de l'arbre disparait
+// donc entierement a la compilation.
+//
+struct NoStats
+{
+  struct Snapshot { };
+  struct Scope 
+  { 
+    explicit Scope(TreeOp) noexcept { } 
+  };
+  static void visit() noexcept { }
+  static void compare() noexcept { }
+  static void restructure() noexcept { }
+  static void allocate() noexcept { }
+  static void release() noexcept { }
+  static Snapshot snapshot() noexcept { return {}; }
+  static void reset() noexcept { }
+};
+
+//
+// @brief Compteurs d'une operation
+//
+// depth est le nombre de noeuds visites par un appel; maxDepth et
+// totalDepth en donnent le maximum et la somme sur tous les appels.
+// L'arbre ne fait pas de rotations : restructures compte les noeuds
+// re-lies (successeur de Hibbard, arborisation).
+//
+struct OpStats
+{
+  size_t calls = 0;
+  size_t comparisons = 0;
+  size_t nodes = 0;
+  size_t maxDepth = 0;
+  size_t totalDepth = 0;
+  size_t restructures = 0;
+  size_t allocations = 0;
+  size_t releases = 0;
+
+  double avgDepth() const noexcept 
+  { 
+    return calls ? double(totalDepth) / calls : 0; 
+  }
+};
+
+inline ostream& operator<<(ostream& os, const OpStats& s)
+{
+  return os << "calls=" << s.calls << " comparisons=" << s.comparisons 
+            << " nodes=" << s.nodes << " maxDepth=" << s.maxDepth 
+            << " avgDepth=" << s.avgDepth() << " restructures=" 
+            << s.restructures << " allocations=" << s.allocations 
+            << " releases=" << s.releases;
+}
+
+//
+// @brief Politique de statistiques comptant par operation et par thread
+//
+// Les compteurs sont thread_local : ils cumulent tous les arbres utilisant
+// cette politique dans le thread courant, sans synchronisation.
+//
+struct CountingStats
+{
+  using Snapshot = array<OpStats, size_t(TreeOp::Count)>;
+
+  //
+  // @brief Delimite une operation publique. Les evenements suivants lui
+  //        sont attribues jusqu'a la destruction du Scope.
+  //
+  class Scope
   {
-    const value_type key; // clé non modifiable
-    Node* right;          // sous arbre avec des cles plus grandes
-    Node* left;           // sous arbre avec des cles plus petites
-    size_t nbElements;    // nombre de noeuds dans le sous arbre dont
-                          // ce noeud est la racine
-    
-    Node(const_reference key)  // seul constructeur disponible. key est obligatoire
-    : key(key), right(nullptr), left(nullptr), nbElements(1)
+    TreeOp previous;
+    size_t previousDepth;
+  public:
+    explicit Scope(TreeOp op) noexcept 
+    : previous(current), previousDepth(depth)
     {
-      cout << "(C" << key << ") ";
+      current = op;
+      depth = 0;
+      table[size_t(op)].calls++;
     }
-    ~Node()               // destructeur
+    ~Scope()
     {
-      cout << "(D" << key << ") ";
+      OpStats& s = table[size_t(current)];
+      s.totalDepth += depth;
+      if (depth > s.maxDepth) 
+      {
+        s.maxDepth = depth;
+      }
+      current = previous;
+      depth = previousDepth;
     }
-    Node() = delete;             // pas de construction par défaut
-    Node(const Node&) = delete;  // pas de construction par copie
-    Node(Node&&) = delete;       // pas de construction par déplacement
+    Scope(const Scope&) = delete;
   };
-  
-  /**
-   *  @brief  Racine de l'arbre. nullptr si l'arbre est vide
-   */
-  Node* _root;
-  
-public:
-  /**
-   *  @brief Constructeur par défaut. Construit un arbre vide
-   *  @remark Complexité O(1)
-   */
-  BinarySearchTree() : _root(nullptr)
-  { }
-  
-  /**
-   *  @brief Constucteur de copie.
-   *
-   *  @param other le BinarySearchTree à copier
-   *  @remark Complexité O(1)
-   *
-   */
-  BinarySearchTree(BinarySearchTree& other) 
+
+  static void visit() noexcept 
+  { 
+    table[size_t(current)].nodes++; 
+    depth++; 
+  }
+  static void compare() noexcept { table[size_t(current)].comparisons++; }
+  static void restructure() noexcept { table[size_t(current)].restructures++; }
+  static void allocate() noexcept { table[size_t(current)].allocations++; }
+  static void release() noexcept { table[size_t(current)].releases++; }
+  static Snapshot snapshot() noexcept { return table; }
+  static void reset() noexcept { table = Snapshot(); }
+
+private:
+  static inline thread_local Snapshot table;
+  static inline thread_local TreeOp current = TreeOp::Other;
+  static inline thread_local size_t depth = 0;
+};
+
+//
+// @brief Horloge des mesures de latence
+//
+// compteur de cycles rdtsc sur x86, dont la frequence est etalonnee une fois
+// contre steady_clock; steady_clock en nanosecondes ailleurs.
+//
+struct TickClock
+{
+  static uint64_t now() noexcept
   {
-      try
-      {
-        _root = nullptr;
-        copyNodes(_root, other._root);  
-      }
-      catch(...)
-      {
-        other.deleteSubTree(_root);
-        throw;
-      }
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+#endif
   }
-  
-  /**
-   * 
-   * @brief Fonction qui permet de copier tous les éléments d'un ABR
-   * 
-   * 
-   * @param r
-   * @param nodeToCopy
-   * 
-   * @remark Complexité 0(1)
-   */
-  void copyNodes(Node *& r, Node *nodeToCopy)
+
+  static double nsPerTick()
   {
-        if (nodeToCopy) 
-        {
-            r = new Node(nodeToCopy->key);
-            r->nbElements = nodeToCopy->nbElements;
+#if defined(__x86_64__) || defined(__i386__)
+    static const double ratio = [] {
+      auto t0 = chrono::steady_clock::now();
+      uint64_t c0 = __rdtsc();
+      this_thread::sleep_for(chrono::milliseconds(10));
+      uint64_t c1 = __rdtsc();
+      double ns = chrono::duration<double, nano>(
+        chrono::steady_clock::now() - t0).count();
+      return ns / double(c1 - c0);
+    }();
+    return ratio;
+#else
+    return 1;
+#endif
+  }
+};
 
-            copyNodes(r->left, nodeToCopy->left);
-            copyNodes(r->right, nodeToCopy->right);
-        }
-    }
+//
+// @brief Histogramme de latences a la HDR
+//
+// chaque puissance de 2 est decoupee en 16 intervalles, soit une precision
+// relative d'environ 6% de 1 a 2^64 ticks en 976 compteurs.
+//
+class LatencyHistogram
+{
+public:
+  static constexpr unsigned subBits = 4;
+  static constexpr size_t subBuckets = size_t(1) << subBits;
+  static constexpr size_t buckets = (65 - subBits) * subBuckets;
 
-  
-  /**
-   *  @brief Opérateur d'affectation par copie.
-   *
-   *  @param other le BinarySearchTree à copier
-   *  @remark Compexité en moyenne en O(1)
-   */
-  BinarySearchTree& operator=(const BinarySearchTree& other) 
+  static size_t bucketOf(uint64_t ticks) noexcept
   {
-        Node* tmp;
-        try 
-        {
-
-            copyNodes(tmp, other._root);
-            deleteSubTree(_root);
-            _root = tmp;
-        } 
-        catch (...) 
-        {
-            deleteSubTree(tmp);
-            throw;
-        }
-        return *this;
+    if (ticks < subBuckets) 
+    {
+      return ticks;
+    }
+    unsigned e = 63 - __builtin_clzll(ticks);
+    return (e - subBits + 1) * subBuckets 
+           + ((ticks >> (e - subBits)) & (subBuckets - 1));
   }
-  
-  /**
-   *  @brief Echange le contenu avec un autre BST
-   *
-   *  @param other le BST avec lequel on echange le contenu
-   *  @remark Compexité en moyenne en O(1)
-   */
-  void swap(BinarySearchTree& other) noexcept 
+
+  static uint64_t lowerBound(size_t bucket) noexcept
   {
-      Node* tmp = other._root;
-      other._root = _root;
-      _root = tmp;
+    if (bucket < 2 * subBuckets) 
+    {
+      return bucket;
+    }
+    unsigned e = unsigned(bucket / subBuckets) + subBits - 1;
+    return (subBuckets + bucket % subBuckets) << (e - subBits);
   }
-  
-  /**
-   *  @brief constructeur de copie par déplacement
-   *
-   *  @param other le BST dont on vole le contenu
-    @remark Compexité en O(1)
-   *
-   */
-  BinarySearchTree(BinarySearchTree&& other) noexcept 
+
+  void add(size_t bucket, uint64_t n) noexcept
   {
-      _root = other._root;
-      other._root = nullptr;
+    counts[bucket] += n;
+    total += n;
   }
-  
-  /**
-   *  @brief Opérateur d'affectation par déplacement.
-   *
-   *  @param other le BST dont on vole le contenu
-   * @remark Compexité en moyenne en O(n)
-   */
-  BinarySearchTree& operator= ( BinarySearchTree&& other ) noexcept 
-{
-        Node* tmp = _root;
-        _root = other._root;
-        deleteSubTree(tmp);
-        other._root = nullptr;
-        return *this;
+
+  uint64_t count() const noexcept 
+  { 
+    return total; 
   }
-  
+
   //
-  // @brief Destructeur
-  // @remark Compexité en moyenne en O(n)
-  // Ne pas modifier mais écrire la fonction
-  // récursive privée deleteSubTree(Node*)
+  // @brief latence en ns sous laquelle tombe la fraction q des mesures
   //
-  ~BinarySearchTree() 
+  // @param q fraction ramenee a [0, 1] ; 1 donne la plus grande mesure
+  // @return le milieu de l'intervalle contenant le quantile, 0 si vide
+  double percentile(double q) const
   {
-    deleteSubTree( _root );
+    if (total == 0) 
+    {
+      return 0;
+    }
+    q = std::min(std::max(q, 0.0), 1.0);
+    uint64_t rank = std::min<uint64_t>(uint64_t(q * total), total - 1);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < buckets; ++b) 
+    {
+      seen += counts[b];
+      if (counts[b] and seen > rank) 
+      {
+        double lo = double(lowerBound(b));
+        double hi = double(b + 1 < buckets ? lowerBound(b + 1) : lo);
+        return (lo + hi) / 2 * nsPerTick;
+      }
+    }
+    return 0;
   }
-  
+
+  double nsPerTick = 1;
+
 private:
+  array<uint64_t, buckets> counts {};
+  uint64_t total = 0;
+};
+
+//
+// @brief Politique mesurant la latence de chaque operation
+//
+// Chaque thread enregistre dans ses propres histogrammes, sans verrou;
+// latency() les fusionne a la demande. Avec setSamplePeriod(p), seul un
+// appel sur p est chronometre. Base est une autre politique dont les
+// compteurs sont conserves, par exemple LatencyStats<CountingStats>.
+//
+template <typename Base = NoStats>
+struct LatencyStats : Base
+{
+  class Scope
+  {
+    typename Base::Scope base;
+    TreeOp op;
+    bool sampled;
+    uint64_t start;
+  public:
+    explicit Scope(TreeOp op) noexcept 
+    : base(op), op(op), sampled(sample()), start(sampled ? TickClock::now() : 0)
+    { }
+    ~Scope() 
+    {
+      if (sampled) 
+      {
+        try 
+        {
+          record(op, TickClock::now() - start);
+        }
+        catch (...) 
+        {
+          // premiere mesure du thread sans memoire : on la perd
+        }
+      }
+    }
+    Scope(const Scope&) = delete;
+  };
+
   //
-  // @brief Fonction détruisant (delete) un sous arbre
+  // @brief histogramme de l'operation op, fusionne sur tous les threads
   //
-  // @param r la racine du sous arbre à détruire.
-  //          peut éventuellement valoir nullptr
-  // @remark Compexité en moyenne en O(n)
-  static void deleteSubTree(Node* r) noexcept 
+  static LatencyHistogram latency(TreeOp op)
   {
-      if(r)
+    LatencyHistogram h;
+    h.nsPerTick = TickClock::nsPerTick();
+    Registry& r = registry();
+    lock_guard<mutex> lock(r.m);
+    for (size_t b = 0; b < LatencyHistogram::buckets; ++b) 
+    {
+      uint64_t n = r.retired[size_t(op)][b];
+      for (ThreadHistograms* t : r.threads) 
+      {
+        n += t->counts[size_t(op)][b].load(memory_order_relaxed);
+      }
+      if (n) 
       {
-          deleteSubTree(r->left);
-          deleteSubTree(r->right);
-          delete r;
-          r->nbElements--;          
+        h.add(b, n);
       }
+    }
+    return h;
   }
 
-public:
-  //
-  // @brief Insertion d'une cle dans l'arbre
-  //
-  // @param key la clé à insérer.
-  //
-  // Ne pas modifier mais écrire la fonction
-  // récursive privée insert(Node*&,const_reference)
-  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
-  void insert( const_reference key) {
-    insert(_root,key);
+  static void setSamplePeriod(unsigned p) noexcept 
+  { 
+    period.store(p ? p : 1, memory_order_relaxed); 
   }
-  
-private:
-  //
-  // @brief Insertion d'une cle dans un sous-arbre
-  //
-  // @param r la racine du sous-arbre dans lequel
-  //          insérer la cle.
-  // @param key la clé à insérer.
+
   //
-  // @return vrai si la cle est inseree. faux si elle etait deja presente.
-  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
-  // Si la cle est deja presente, cette fonction ne fait rien.
-  // x peut éventuellement valoir nullptr en entrée.
-  // la fonction peut modifier x, reçu par référence, si nécessaire
+  // @brief vide les histogrammes de tous les threads
   //
-  static bool insert(Node*& r, const_reference key) 
+  static void resetLatency()
   {
-    if (!r)
+    Registry& r = registry();
+    lock_guard<mutex> lock(r.m);
+    r.retired = {};
+    for (ThreadHistograms* t : r.threads) 
     {
-        r = new Node(key); 
-        return true;
-    }
-    else if (key < r->key)
-    {    
-        if(!insert(r->left, key))
+      for (auto& op : t->counts) 
+      {
+        for (auto& c : op) 
         {
-            return false;
+          c.store(0, memory_order_relaxed);
         }
+      }
     }
-    else if (key > r->key)
+  }
+
+private:
+  using Counts = array<uint64_t, LatencyHistogram::buckets>;
+
+  struct ThreadHistograms;
+
+  struct Registry
+  {
+    mutex m;
+    vector<ThreadHistograms*> threads;
+    array<Counts, size_t(TreeOp::Count)> retired {}; // threads termines
+  };
+
+  static Registry& registry()
+  {
+    static Registry r;
+    return r;
+  }
+
+  //
+  // histogrammes d'un thread. Un seul ecrivain : les compteurs sont
+  // atomiques pour que latency() puisse les lire, pas pour les incrementer.
+  //
+  struct ThreadHistograms
+  {
+    array<array<atomic<uint64_t>, LatencyHistogram::buckets>, 
+          size_t(TreeOp::Count)> counts {};
+
+    ThreadHistograms()
+    {
+      Registry& r = registry();
+      lock_guard<mutex> lock(r.m);
+      r.threads.push_back(this);
+    }
+    ~ThreadHistograms()
     {
-        if(!insert(r->right, key))
+      Registry& r = registry();
+      lock_guard<mutex> lock(r.m);
+      for (size_t op = 0; op < counts.size(); ++op) 
+      {
+        for (size_t b = 0; b < LatencyHistogram::buckets; ++b) 
         {
-            return false;
+          r.retired[op][b] += counts[op][b].load(memory_order_relaxed);
         }
+      }
+      r.threads.erase(find(r.threads.begin(), r.threads.end(), this));
     }
-    else
+  };
+
+  static bool sample() noexcept
+  {
+    if (countdown > 1) 
     {
-        return false;
+      countdown--;
+      return false;
     }
-    r->nbElements++;
+    countdown = period.load(memory_order_relaxed);
     return true;
   }
-  
+
+  static void record(TreeOp op, uint64_t ticks)
+  {
+    if (!local) 
+    {
+      local.reset(new ThreadHistograms());
+    }
+    atomic<uint64_t>& c = local->counts[size_t(op)][LatencyHistogram::bucketOf(ticks)];
+    c.store(c.load(memory_order_relaxed) + 1, memory_order_relaxed);
+  }
+
+  static inline thread_local unique_ptr<ThreadHistograms> local;
+  static inline thread_local unsigned countdown = 0;
+  static inline atomic<unsigned> period { 1 };
+};
+
+//
+// @brief Evenements traces par BinarySearchTree
+//
+// les noms sont ceux des sondes USDT du fournisseur bst, par exemple
+//   bpftrace -e 'usdt:./laboBinaryTree:bst:rebalance_begin { @[arg0] = count(); }'
+//
+enum class TraceEvent { node_alloc, node_free, restructure, rebalance_begin, 
+                        rebalance_end, linearize_begin, linearize_end, 
+                        arborize_begin, arborize_end, relocate_begin, 
+                        relocate_end, Count };
+
+inline const char* name(TraceEvent e)
+{
+  static const char* names[] = { "node_alloc", "node_free", "restructure", 
+    "rebalance_begin", "rebalance_end", "linearize_begin", "linearize_end", 
+    "arborize_begin", "arborize_end", "relocate_begin", "relocate_end" };
+  return names[size_t(e)];
+}
+
+//
+// @brief Anneau d'evenements du thread courant (compile avec -DBST_TRACE_RING)
+//
+// garde les capacity derniers evenements, sans allocation ni verrou, et les
+// exporte au format Chrome trace (chrome://tracing, Perfetto). Les paires
+// *_begin / *_end deviennent des tranches, les autres des instants.
+//
+class TraceRing
+{
 public:
-  //
-  // @brief Recherche d'une cle.
-  //
-  // @param key la cle a rechercher
-  //
-  // @return vrai si la cle trouvee, faux sinon.
-  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
-  //
-  // Ne pas modifier mais écrire la fonction
-  // récursive privée contains(Node*,const_reference)
-  //
-  bool contains( const_reference key ) const noexcept 
+  static constexpr size_t capacity = size_t(1) << 14;
+
+  struct Entry
+  {
+    uint64_t ticks;
+    TraceEvent event;
+    uint64_t arg;
+  };
+
+  static void record(TraceEvent event, uint64_t arg) noexcept
   {
-    return contains(_root,key);
+    Ring& r = ring;
+    r.entries[r.next++ % capacity] = { TickClock::now(), event, arg };
   }
-  
-private:
-  //
-  // @brief Recherche d'une cle dans un sous-arbre
+
+  static void clear() noexcept 
+  { 
+    ring.next = 0; 
+  }
+
   //
-  // @param key la cle a rechercher
-  // @param r   la racine du sous-arbre
-  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
-  // @return vrai si la cle trouvee, faux sinon.
+  // @brief ecrit les evenements du thread courant en JSON Chrome trace
   //
-  static bool contains(Node* r, const_reference key) noexcept 
+  // le format de os (fixed, precision) est retabli en sortant
+  static void exportChrome(ostream& os, unsigned tid = 0)
   {
-      if (!r)
-      {
-          return false;
-      }
-      else if (key < r->key)
-      {
-          contains(r->left, key);
-      }
-      else if (key > r->key)
+    ios_base::fmtflags flags = os.flags();
+    streamsize precision = os.precision();
+    const Ring& r = ring;
+    size_t n = std::min(r.next, capacity);
+    double usPerTick = TickClock::nsPerTick() / 1000;
+    uint64_t origin = n ? r.entries[(r.next - n) % capacity].ticks : 0;
+    os << "{\"traceEvents\": [";
+    for (size_t i = r.next - n; i < r.next; ++i) 
+    {
+      const Entry& e = r.entries[i % capacity];
+      string event = name(e.event);
+      const char* phase = "i";
+      size_t cut = event.rfind('_');
+      string suffix = event.substr(cut + 1);
+      if (suffix == "begin" or suffix == "end") 
       {
-          contains(r->right, key);
+        phase = suffix == "begin" ? "B" : "E";
+        event = event.substr(0, cut);
       }
-      else
+      os << (i + n == r.next ? "" : ",") << "\n  {\"name\": \"" << event 
+         << "\", \"ph\": \"" << phase << "\", \"ts\": " << fixed 
+         << setprecision(3) << (e.ticks - origin) * usPerTick 
+         << ", \"pid\": 1, \"tid\": " << tid;
+      if (*phase == 'i') 
       {
-          return true;
+        os << ", \"s\": \"t\"";
       }
+      os << ", \"args\": {\"arg\": " << e.arg << "}}";
+    }
+    os << "\n]}\n";
+    os.flags(flags);
+    os.precision(precision);
   }
-  
-public:
-  //
-  // @brief Recherche de la cle minimale.
-  //
-  // @return une const reference a la cle minimale
-  //
-  // @exception std::logic_error si necessaire
-  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
-  // vous pouvez mettre en oeuvre de manière iterative ou recursive a choix
-  //
-  const_reference min() const 
+
+private:
+  // initialise a zero comme toute variable thread_local
+  struct Ring
+  {
+    array<Entry, capacity> entries;
+    size_t next;
+  };
+  static inline thread_local Ring ring;
+};
+
+//
+// BST_TRACE(event, arg) : sonde USDT si <sys/sdt.h> est disponible (un nop
+// tant qu'aucun outil n'y est attache), plus l'anneau si BST_TRACE_RING est
+// defini. Sans l'un ni l'autre, rien n'est genere.
+//
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>) && !defined(BST_NO_USDT)
+#include <sys/sdt.h>
+#define BST_USDT(event, arg) DTRACE_PROBE1(bst, event, arg)
+#endif
+#endif
+#ifndef BST_USDT
+#define BST_USDT(event, arg) ((void) 0)
+#endif
+
+#ifdef BST_TRACE_RING
+#define BST_RING(event, arg) TraceRing::record(TraceEvent::event, uint64_t(arg))
+#else
+#define BST_RING(event, arg) ((void) 0)
+#endif
+
+#define BST_TRACE(event, arg) \
+  do { BST_USDT(event, arg); BST_RING(event, arg); } while (0)
+
+//
+// @brief Forme d'un arbre, calculee par BinarySearchTree::shape_report
+//
+// Les profondeurs commencent a 0 a la racine et height est le nombre de
+// niveaux. size est le nombre de noeuds : les occurrences d'un multiset ne
+// changent pas la forme. depthHistogram[d] est le nombre de noeuds de
+// profondeur d.
+// worstImbalance est le plus grand rapport, sur tous les noeuds, entre les
+// nbElements du plus gros et du plus petit sous-arbre, chacun augmente de 1 :
+// il vaut 1 pour un arbre parfait et n pour une liste. heightRatio compare
+// height a la hauteur minimale floor(log2(n)) + 1.
+//
+// Si sampled est vrai, le rapport est estime a partir de samples descentes
+// ponderees vers des noeuds tires uniformement : height et worstImbalance
+// sont alors des bornes inferieures et depthHistogram est ramene a size
+// noeuds.
+//
+struct ShapeReport
+{
+  size_t size = 0;
+  size_t height = 0;
+  double avgDepth = 0;
+  vector<size_t> depthHistogram;
+  double worstImbalance = 1;
+  double heightRatio = 1;
+  bool sampled = false;
+  size_t samples = 0;
+
+  static size_t optimalHeight(size_t n) noexcept
   {
-    if (_root == nullptr)
+    size_t h = 0;
+    for (; n; n >>= 1) 
     {
-        throw std::logic_error("logic_error_min");
+      ++h;
     }
+    return h;
+  }
 
-    Node* tmpNode = _root;
+  void addNode(size_t left, size_t right) noexcept
+  {
+    double ratio = double(std::max(left, right) + 1) / (std::min(left, right) + 1);
+    if (ratio > worstImbalance) 
+    {
+      worstImbalance = ratio;
+    }
+  }
 
-    while (tmpNode->left != nullptr)
+  // un noeud de profondeur depth, compte weight fois (1 sauf echantillon)
+  void addDepth(size_t depth, double weight = 1)
+  {
+    if (depth >= _mass.size()) 
     {
-        tmpNode = tmpNode->left;
+      _mass.resize(depth + 1);
     }
+    _mass[depth] += weight;
+    _total += weight;
+    avgDepth += depth * weight;
+  }
 
-    return tmpNode->key;
+  // termine le calcul une fois toutes les profondeurs ajoutees
+  void finish()
+  {
+    height = _mass.size();
+    avgDepth = _total ? avgDepth / _total : 0;
+    heightRatio = size ? double(height) / optimalHeight(size) : 1;
+    depthHistogram.resize(height);
+    for (size_t d = 0; d < height; ++d) 
+    {
+      depthHistogram[d] = size_t(_mass[d] * size / _total + 0.5);
+    }
   }
 
   //
-  // @brief Supprime le plus petit element de l'arbre.
-  //
-  // @exception std::logic_error si necessaire
+  // @brief ecrit le rapport au format texte de Prometheus
   //
-  // vous pouvez mettre en oeuvre de manière iterative ou recursive a choix
-  // @remark Compexité en moyenne en O(log(n))
-  void deleteMin() 
+  void exportMetrics(ostream& os, const string& prefix = "bst") const
+  {
+    os << prefix << "_size " << size << "\n"
+       << prefix << "_height " << height << "\n"
+       << prefix << "_height_ratio " << heightRatio << "\n"
+       << prefix << "_avg_depth " << avgDepth << "\n"
+       << prefix << "_worst_imbalance " << worstImbalance << "\n"
+       << prefix << "_sampled " << sampled << "\n";
+    for (size_t d = 0; d < depthHistogram.size(); ++d) 
+    {
+      os << prefix << "_depth_nodes{depth=\"" << d << "\"} " 
+         << depthHistogram[d] << "\n";
+    }
+  }
+
+private:
+  vector<double> _mass; // poids des noeuds vus, par profondeur
+  double _total = 0;
+};
+
+//
+// @brief Declenchement du re-equilibrage automatique
+//
+// Off       aucune observation (defaut)
+// Inline    balance() est execute dans la premiere operation modifiante
+//           (insert, deleteElement, deleteMin) qui suit le franchissement
+//           du seuil, contains etant const
+// Amortized chaque insertion trop profonde reconstruit le plus petit
+//           sous-arbre desequilibre de son chemin (bouc emissaire), les
+//           recherches trop profondes declenchent balance() comme Inline
+// Deferred  le seuil ne fait que marquer le re-equilibrage comme en attente;
+//           l'appelant l'execute avec maintain(), par exemple depuis une
+//           tache de fond qui detient son verrou
+//
+enum class RebalanceMode { Off, Inline, Amortized, Deferred };
+
+//
+// @brief Politique de re-equilibrage automatique
+//
+// Une insertion ou une recherche est trop profonde si elle atteint plus de
+// depthFactor * log2(size()) niveaux. Le re-equilibrage est declenche quand
+// plus de maxViolations d'entre elles surviennent dans une fenetre de window
+// observations.
+//
+struct RebalancePolicy
+{
+  RebalanceMode mode = RebalanceMode::Off;
+  double depthFactor = 2;
+  size_t maxViolations = 16;
+  size_t window = 1024;
+};
+
+//
+// @brief Memoire dynamique possedee par une cle, hors sizeof de la cle
+//
+// Point de personnalisation de BinarySearchTree::memory_usage : surcharger
+// heap_usage pour ses propres types de cles, dans leur espace de noms.
+//
+template <typename K>
+size_t heap_usage(const K&) noexcept
+{
+  return 0;
+}
+
+template <typename C, typename Tr, typename A>
+size_t heap_usage(const basic_string<C, Tr, A>& s) noexcept
+{
+  // une chaine courte est stockee dans l'objet lui-meme (SSO)
+  const char* data = reinterpret_cast<const char*>(s.data());
+  const char* self = reinterpret_cast<const char*>(&s);
+  if (data >= self and data < self + sizeof(s))
   {
-      delete removeMinAndReturnIt(_root);
+    return 0;
   }
-  
-  static Node* removeMinAndReturnIt(Node* leaf)
+  return (s.capacity() + 1) * sizeof(C);
+}
+
+template <typename E, typename A>
+size_t heap_usage(const vector<E, A>& v) noexcept
+{
+  size_t bytes = v.capacity() * sizeof(E);
+  for (const E& e : v)
   {
-      if (leaf == nullptr) 
-      {
-         throw logic_error("std::Logic_error");
-      }
+    bytes += heap_usage(e);
+  }
+  return bytes;
+}
 
-      Node *cur = leaf;
-      cur->nbElements--;
-      if (!cur->left) 
-      {
-          cur = cur->right;
-          return cur;
-      }
-      while (cur->left->left) 
+//
+// @brief Empreinte memoire d'un arbre, rendue par memory_usage
+//
+// Les noeuds sont pris dans les blocs d'une NodePool : allocatorOverhead
+// compte la table des blocs et slack les emplacements reserves mais
+// inoccupes (liberes ou jamais utilises).
+//
+struct MemoryUsage
+{
+  size_t nodes = 0;             // noeuds alloues
+  size_t nodeBytes = 0;         // nodes * sizeof(Node)
+  size_t allocatorOverhead = 0; // gestion des blocs de noeuds
+  size_t slack = 0;             // emplacements de noeuds inoccupes
+  size_t keyHeapBytes = 0;      // memoire dynamique possedee par les cles
+  size_t objectBytes = 0;       // l'objet arbre lui-meme
+  size_t hugePageAdvisedBytes = 0; // part des blocs demandee en pages de 
+                                   // 2 Mo, deja comptee dans nodeBytes et
+                                   // slack. Voir PageBacking
+
+  size_t total() const noexcept 
+  {
+    return nodeBytes + allocatorOverhead + slack + keyHeapBytes + objectBytes;
+  }
+};
+
+inline ostream& operator<<(ostream& os, const MemoryUsage& m)
+{
+  return os << "nodes=" << m.nodes << " nodeBytes=" << m.nodeBytes 
+            << " allocatorOverhead=" << m.allocatorOverhead << " slack=" 
+            << m.slack << " keyHeapBytes=" << m.keyHeapBytes 
+            << " objectBytes=" << m.objectBytes << " hugePageAdvisedBytes=" 
+            << m.hugePageAdvisedBytes << " total=" << m.total();
+}
+
+//
+// @brief Pages memoire des blocs de noeuds
+//
+// Default         blocs pris a operator new
+// TransparentHuge blocs de multiples de 2 Mo alignes, signales au noyau par
+//                 madvise(MADV_HUGEPAGE) pour qu'il les serve en pages de
+//                 2 Mo (THP)
+// ExplicitHuge    blocs mmap(MAP_HUGETLB) pris aux pages de 2 Mo reservees
+//                 (vm.nr_hugepages). A defaut, comme TransparentHuge
+//
+// Une descente parcourt des noeuds eparpilles dans tout le tas : avec des
+// pages de 2 Mo, bien moins d'entrees de TLB couvrent les memes noeuds.
+// Si le systeme ne fournit pas ces pages, les blocs retombent sur des pages
+// ordinaires. MemoryUsage::hugePageAdvisedBytes compte les blocs demandes
+// en pages de 2 Mo : ceux de MAP_HUGETLB les ont, mais madvise n'est qu'un
+// conseil, accepte meme si THP vaut never ou si le noyau ne regroupe pas
+// les pages. AnonHugePages dans /proc/self/smaps dit ce qui a ete obtenu.
+//
+enum class PageBacking { Default, TransparentHuge, ExplicitHuge };
+
+inline const char* name(PageBacking backing)
+{
+  switch (backing)
+  {
+    case PageBacking::Default: return "default";
+    case PageBacking::TransparentHuge: return "thp";
+    case PageBacking::ExplicitHuge: return "hugetlb";
+  }
+  return "?";
+}
+
+//
+// @brief Reserve des noeuds d'un arbre
+//
+// alloue des emplacements de SlotSize octets dans des blocs contigus de
+// taille croissante et recycle les emplacements liberes par une liste
+// chainee a travers leur propre memoire. Les blocs ne sont rendus qu'a la
+// destruction de la reserve : BinarySearchTree::compact en change pour
+// regrouper les noeuds.
+//
+template <size_t SlotSize, size_t SlotAlign>
+class NodePool
+{
+  static_assert(SlotSize >= sizeof(void*) and SlotSize % SlotAlign == 0, 
+                "emplacement trop petit ou mal aligne");
+
+  struct Chunk
+  {
+    unsigned char* data;
+    size_t slots;
+    size_t mapped; // octets obtenus par mmap, 0 si pris a operator new
+  };
+
+  static constexpr size_t firstChunk = 64;
+  static constexpr size_t maxChunk = size_t(1) << 20;
+  static constexpr size_t hugePage = size_t(1) << 21;
+
+  vector<Chunk> _chunks;
+  unsigned char* _next = nullptr; // premier emplacement jamais utilise
+  unsigned char* _end = nullptr;  // fin du dernier bloc
+  void* _free = nullptr;          // emplacements liberes
+  size_t _capacity = 0;           // emplacements de tous les blocs
+  PageBacking _backing = PageBacking::Default; // pour les blocs suivants
+  size_t _advisedBytes = 0;       // octets demandes en pages de 2 Mo
+
+public:
+  NodePool() = default;
+  NodePool(const NodePool&) = delete;
+  NodePool& operator=(const NodePool&) = delete;
+
+  NodePool(NodePool&& other) noexcept 
+  {
+    swap(other);
+  }
+
+  NodePool& operator=(NodePool&& other) noexcept 
+  {
+    NodePool tmp(std::move(other));
+    swap(tmp);
+    return *this;
+  }
+
+  ~NodePool()
+  {
+    for (const Chunk& c : _chunks) 
+    {
+      if (c.mapped) 
       {
-          cur = cur->left;
-          cur->nbElements--;
+        unmap(c.data, c.mapped);
       }
-      Node* cur_left = cur->left;
-      
-      if (cur_left->right) 
-      {
-          cur->left = cur_left->right;
-      } 
       else 
       {
-          cur->left = nullptr;         
+        ::operator delete(c.data, c.slots * SlotSize, align_val_t(SlotAlign));
       }
-      
-      return cur_left;
-   }
-  
-  
+    }
+  }
+
+  void swap(NodePool& other) noexcept
+  {
+    std::swap(_chunks, other._chunks);
+    std::swap(_next, other._next);
+    std::swap(_end, other._end);
+    std::swap(_free, other._free);
+    std::swap(_capacity, other._capacity);
+    std::swap(_backing, other._backing);
+    std::swap(_advisedBytes, other._advisedBytes);
+  }
+
   //
-  // @brief Supprime l'element de cle key de l'arbre.
+  // @brief emplacement non initialise pour un noeud
   //
-  // @param key l'element a supprimer
-  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
-  // si l'element n'est pas present, la fonction ne modifie pas
-  // l'arbre mais retourne false. Si l'element est present, elle
-  // retourne vrai
+  // @exception std::bad_alloc si un nouveau bloc ne peut etre alloue
+  // @remark Complexité O(1) amorti
+  void* allocate()
+  {
+    if (_free) 
+    {
+      void* p = _free;
+      _free = *static_cast<void**>(p);
+      return p;
+    }
+    if (_next == _end) 
+    {
+      reserve(std::min(maxChunk, std::max(firstChunk, _capacity)));
+    }
+    void* p = _next;
+    _next += SlotSize;
+    return p;
+  }
+
+  void release(void* p) noexcept
+  {
+    *static_cast<void**>(p) = _free;
+    _free = p;
+  }
+
   //
-  // Ne pas modifier mais écrire la fonction
-  // récursive privée deleteElement(Node*&,const_reference)
+  // @brief ajoute un bloc de slots emplacements, servis dans l'ordre des
+  //        adresses par les allocate suivants
   //
-  bool deleteElement( const_reference key) noexcept 
+  // les emplacements jamais utilises du bloc precedent sont abandonnes.
+  // Hors PageBacking::Default, le bloc est arrondi a un multiple de 2 Mo.
+  void reserve(size_t slots)
   {
-    return deleteElement( _root, key );
+    _chunks.reserve(_chunks.size() + 1);
+    size_t bytes = slots * SlotSize;
+    size_t mapped = 0;
+    unsigned char* data = nullptr;
+    if (_backing != PageBacking::Default) 
+    {
+      bytes = (bytes + hugePage - 1) / hugePage * hugePage;
+      bool advised = false;
+      data = static_cast<unsigned char*>(map(bytes, _backing, advised));
+      if (data) 
+      {
+        mapped = bytes;
+        slots = bytes / SlotSize;
+        _advisedBytes += advised ? bytes : 0;
+      }
+      else 
+      {
+        bytes = slots * SlotSize;
+      }
+    }
+    if (!data) 
+    {
+      data = static_cast<unsigned char*>(
+        ::operator new(bytes, align_val_t(SlotAlign)));
+    }
+    _chunks.push_back({ data, slots, mapped });
+    _capacity += slots;
+    _next = data;
+    _end = data + slots * SlotSize;
   }
-  
-private:
+
   //
-  // @brief Supprime l'element de cle key du sous arbre.
+  // @brief pages des blocs alloues desormais. Les blocs existants restent
+  //        ou ils sont
   //
-  // @param r la racine du sous arbre
-  // @param key l'element a supprimer
-  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
-  // si l'element n'est pas present, la fonction ne modifie pas
-  // l'arbre mais retourne false. Si l'element est present, elle
-  // retourne vrai
-    static bool deleteElement(Node*& r, const_reference key) noexcept
-    {
-        if (r) 
-        {
-            if (key < r->key) // key recherchée inférieure au noeud actuel, on va
-            { // chercher à gauche
-                if (deleteElement(r->left, key)) // si on trouve la clé
-                {
-                    r->nbElements--;
-                    return true;
+  void setBacking(PageBacking backing) noexcept 
+  { 
+    _backing = backing; 
+  }
+
+  PageBacking backing() const noexcept 
+  { 
+    return _backing; 
+  }
+
+  size_t hugePageAdvisedBytes() const noexcept 
+  { 
+    return _advisedBytes; 
+  }
+
+  size_t capacity() const noexcept 
+  { 
+    return _capacity; 
+  }
+
+  size_t chunks() const noexcept 
+  { 
+    return _chunks.size(); 
+  }
+
+  size_t bookkeepingBytes() const noexcept 
+  { 
+    return _chunks.capacity() * sizeof(Chunk); 
+  }
+
+private:
+  //
+  // @brief bytes octets (multiple de 2 Mo) en pages de 2 Mo si possible
+  //
+  // @param advised vrai si MAP_HUGETLB ou madvise(MADV_HUGEPAGE) a reussi,
+  //                ce qui dans le second cas ne garantit pas les pages
+  // @return nullptr si mmap echoue ou hors Linux
+  static void* map(size_t bytes, PageBacking backing, bool& advised) noexcept
+  {
+#ifdef __linux__
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (backing == PageBacking::ExplicitHuge) 
+    {
+#ifdef MAP_HUGE_SHIFT
+      int size = 21 << MAP_HUGE_SHIFT;
+#else
+      int size = 0; // taille par defaut des pages enormes
+#endif
+      void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, 
+                     flags | MAP_HUGETLB | size, -1, 0);
+      if (p != MAP_FAILED) 
+      {
+        advised = true;
+        return p;
+      }
+    }
+    // THP : on reserve 2 Mo de plus pour aligner le bloc sur une page
+    // enorme, puis on rend ce qui depasse de part et d'autre
+    size_t span = bytes + hugePage;
+    void* raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (raw == MAP_FAILED) 
+    {
+      return nullptr;
+    }
+    uintptr_t begin = (uintptr_t(raw) + hugePage - 1) & ~(hugePage - 1);
+    size_t head = begin - uintptr_t(raw);
+    if (head) 
+    {
+      munmap(raw, head);
+    }
+    if (span - head - bytes) 
+    {
+      munmap(reinterpret_cast<void*>(begin + bytes), span - head - bytes);
+    }
+#ifdef MADV_HUGEPAGE
+    advised = madvise(reinterpret_cast<void*>(begin), bytes, 
+                      MADV_HUGEPAGE) == 0;
+#endif
+    return reinterpret_cast<void*>(begin);
+#else
+    (void) bytes;
+    (void) backing;
+    advised = false;
+    return nullptr;
+#endif
+  }
+
+  static void unmap(void* data, size_t bytes) noexcept
+  {
+#ifdef __linux__
+    munmap(data, bytes);
+#else
+    (void) data;
+    (void) bytes;
+#endif
+  }
+};
+
+//
+// @brief Ordre des noeuds en memoire apres BinarySearchTree::compact
+//
+// InOrder      ordre croissant des cles : les parcours symetriques lisent
+//              la memoire sequentiellement
+// BreadthFirst ordre des niveaux : les premiers niveaux de toutes les
+//              descentes partagent quelques lignes de cache et pages
+//
+enum class CompactOrder { InOrder, BreadthFirst };
+
+//
+// @brief Noeuds NUMA de la machine
+//
+// Compile avec -DBST_LIBNUMA (et lie a -lnuma), s'appuie sur libnuma. Sinon,
+// ou si le noyau ne gere pas NUMA (numa_available() < 0), la machine est vue
+// comme un seul noeud 0 et la memoire vient d'operator new.
+//
+struct NumaTopology
+{
+  static bool available() noexcept
+  {
+#ifdef BST_LIBNUMA
+    static const bool numa = numa_available() >= 0;
+    return numa;
+#else
+    return false;
+#endif
+  }
+
+  static int nodes() noexcept
+  {
+#ifdef BST_LIBNUMA
+    if (available()) 
+    {
+      return numa_max_node() + 1;
+    }
+#endif
+    return 1;
+  }
+
+  //
+  // @brief noeud du processeur qui execute le thread appelant
+  //
+  static int currentNode() noexcept
+  {
+#ifdef BST_LIBNUMA
+    if (available()) 
+    {
+      int cpu = sched_getcpu();
+      int node = cpu < 0 ? 0 : numa_node_of_cpu(cpu);
+      return node < 0 ? 0 : node;
+    }
+#endif
+    return 0;
+  }
+
+  //
+  // @brief bytes octets sur node, ou sans preference si node vaut -1
+  //
+  // @exception std::bad_alloc si l'allocation echoue
+  static void* allocate(size_t bytes, size_t align, int node)
+  {
+#ifdef BST_LIBNUMA
+    if (onNode(node)) 
+    {
+      // numa_alloc_onnode rend des pages entieres : alignement suffisant
+      void* p = numa_alloc_onnode(bytes ? bytes : 1, node);
+      if (!p) 
+      {
+        throw bad_alloc();
+      }
+      return p;
+    }
+#else
+    (void) node;
+#endif
+    return ::operator new(bytes, align_val_t(align));
+  }
+
+  static void release(void* p, size_t bytes, size_t align, int node) noexcept
+  {
+#ifdef BST_LIBNUMA
+    if (onNode(node)) 
+    {
+      numa_free(p, bytes ? bytes : 1);
+      return;
+    }
+#else
+    (void) bytes;
+    (void) node;
+#endif
+    ::operator delete(p, align_val_t(align));
+  }
+
+private:
+  static bool onNode(int node) noexcept
+  {
+    return available() and node >= 0 and node < nodes();
+  }
+};
+
+//
+// @brief Allocateur standard qui place ses elements sur un noeud NUMA
+//
+template <typename T>
+struct NodeLocalAllocator
+{
+  using value_type = T;
+  using propagate_on_container_move_assignment = true_type;
+  using propagate_on_container_swap = true_type;
+
+  int node = -1; // -1 : pas de preference
+
+  NodeLocalAllocator() noexcept = default;
+
+  explicit NodeLocalAllocator(int node) noexcept : node(node) 
+  { }
+
+  template <typename U>
+  NodeLocalAllocator(const NodeLocalAllocator<U>& other) noexcept 
+  : node(other.node) 
+  { }
+
+  T* allocate(size_t n)
+  {
+    return static_cast<T*>(
+      NumaTopology::allocate(n * sizeof(T), alignof(T), node));
+  }
+
+  void deallocate(T* p, size_t n) noexcept
+  {
+    NumaTopology::release(p, n * sizeof(T), alignof(T), node);
+  }
+
+  template <typename U>
+  bool operator==(const NodeLocalAllocator<U>& other) const noexcept 
+  { 
+    return node == other.node; 
+  }
+
+  template <typename U>
+  bool operator!=(const NodeLocalAllocator<U>& other) const noexcept 
+  { 
+    return node != other.node; 
+  }
+};
+
+//
+// @brief Jeux d'instructions des noyaux de recherche de FrozenSnapshot
+//
+enum class SimdLevel { Scalar, Avx2, Avx512 };
+
+inline const char* name(SimdLevel level)
+{
+  switch (level)
+  {
+    case SimdLevel::Scalar: return "scalar";
+    case SimdLevel::Avx2: return "avx2";
+    case SimdLevel::Avx512: return "avx512";
+  }
+  return "?";
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BST_SIMD_X86 1
+#endif
+
+//
+// @brief meilleur jeu d'instructions du processeur, detecte a l'execution
+//
+inline SimdLevel detectSimd() noexcept
+{
+#ifdef BST_SIMD_X86
+  if (__builtin_cpu_supports("avx512f")) 
+  {
+    return SimdLevel::Avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) 
+  {
+    return SimdLevel::Avx2;
+  }
+#endif
+  return SimdLevel::Scalar;
+}
+
+//
+// @brief Recherche dans un index statique de blocs de 16 cles
+//
+// Les cles triees forment les feuilles, par blocs de Block cles. Chaque
+// niveau superieur garde, pour chaque bloc du niveau du dessous, sa plus
+// grande cle, et est a son tour coupe en blocs de Block cles, jusqu'a un
+// seul bloc (disposition d'un B-arbre statique a Block + 1 branches). Les
+// niveaux sont ranges du haut vers le bas dans index, niveau l a partir de
+// levels[l].
+//
+// Dans un bloc, le nombre de cles inferieures a key donne directement le
+// bloc fils a suivre : une comparaison vectorielle de tout le bloc et un
+// popcount, sans branchement dependant des donnees. Avx2 et Avx512 sont
+// compiles avec l'attribut target, choisis a l'execution, et se rabattent
+// sur la boucle scalaire pour les cles d'autres tailles que 4 ou 8 octets.
+//
+template <typename T>
+struct BlockSearch
+{
+  static constexpr size_t Block = 16;
+
+  using Fn = size_t (*)(const T* index, const size_t* levels, size_t height, 
+                        const T* keys, size_t n, T key);
+
+  static Fn select(SimdLevel level) noexcept
+  {
+#ifdef BST_SIMD_X86
+    if (sizeof(T) == 4 or sizeof(T) == 8) 
+    {
+      if (level == SimdLevel::Avx512) 
+      {
+        return &avx512;
+      }
+      if (level == SimdLevel::Avx2) 
+      {
+        return &avx2;
+      }
+    }
+#else
+    (void) level;
+#endif
+    return &scalar;
+  }
+
+  //
+  // @return le nombre de cles de keys[0, n) inferieures a key
+  // @remark Complexité O(log(n))
+  static size_t scalar(const T* index, const size_t* levels, size_t height, 
+                       const T* keys, size_t n, T key)
+  {
+    if (n == 0 or keys[n - 1] < key) 
+    {
+      return n;
+    }
+    size_t block = 0;
+    for (size_t l = 0; l < height; ++l) 
+    {
+      block = block * Block + less(index + levels[l] + block * Block, key);
+    }
+    size_t first = block * Block;
+    if (first + Block <= n) 
+    {
+      return first + less(keys + first, key);
+    }
+    return tail(keys, n, first, key);
+  }
+
+private:
+  static size_t less(const T* b, T key) noexcept
+  {
+    size_t c = 0;
+    for (size_t i = 0; i < Block; ++i) 
+    {
+      c += b[i] < key;
+    }
+    return c;
+  }
+
+  // le dernier bloc des feuilles peut etre incomplet
+  static size_t tail(const T* keys, size_t n, size_t first, T key) noexcept
+  {
+    size_t c = first;
+    while (c < n and keys[c] < key) 
+    {
+      ++c;
+    }
+    return c;
+  }
+
+#ifdef BST_SIMD_X86
+  __attribute__((target("avx2")))
+  static size_t less2(const T* b, T key) noexcept
+  {
+    unsigned mask = 0;
+    if constexpr (is_same_v<T, float>) 
+    {
+      __m256 k = _mm256_set1_ps(key);
+      mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(b), k, _CMP_LT_OQ))
+           | _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(b + 8), k, 
+                                              _CMP_LT_OQ)) << 8;
+    }
+    else if constexpr (is_same_v<T, double>) 
+    {
+      __m256d k = _mm256_set1_pd(key);
+      for (size_t i = 0; i < Block; i += 4) 
+      {
+        mask |= unsigned(_mm256_movemask_pd(
+          _mm256_cmp_pd(_mm256_loadu_pd(b + i), k, _CMP_LT_OQ))) << i;
+      }
+    }
+    else if constexpr (is_integral_v<T> and sizeof(T) == 4) 
+    {
+      // sans comparaison non signee en AVX2 : on decale les deux operandes
+      const int bias = is_signed_v<T> ? 0 : INT32_MIN;
+      __m256i k = _mm256_set1_epi32(int(key) ^ bias);
+      __m256i flip = _mm256_set1_epi32(bias);
+      for (size_t i = 0; i < Block; i += 8) 
+      {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(b + i)), flip);
+        mask |= unsigned(_mm256_movemask_ps(
+          _mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v)))) << i;
+      }
+    }
+    else if constexpr (is_integral_v<T> and sizeof(T) == 8) 
+    {
+      const long long bias = is_signed_v<T> ? 0 : INT64_MIN;
+      __m256i k = _mm256_set1_epi64x((long long) key ^ bias);
+      __m256i flip = _mm256_set1_epi64x(bias);
+      for (size_t i = 0; i < Block; i += 4) 
+      {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(b + i)), flip);
+        mask |= unsigned(_mm256_movemask_pd(
+          _mm256_castsi256_pd(_mm256_cmpgt_epi64(k, v)))) << i;
+      }
+    }
+    else 
+    {
+      return less(b, key);
+    }
+    return __builtin_popcount(mask);
+  }
+
+  __attribute__((target("avx2")))
+  static size_t avx2(const T* index, const size_t* levels, size_t height, 
+                     const T* keys, size_t n, T key)
+  {
+    if (n == 0 or keys[n - 1] < key) 
+    {
+      return n;
+    }
+    size_t block = 0;
+    for (size_t l = 0; l < height; ++l) 
+    {
+      block = block * Block + less2(index + levels[l] + block * Block, key);
+    }
+    size_t first = block * Block;
+    if (first + Block <= n) 
+    {
+      return first + less2(keys + first, key);
+    }
+    return tail(keys, n, first, key);
+  }
+
+  __attribute__((target("avx512f")))
+  static size_t less512(const T* b, T key) noexcept
+  {
+    unsigned mask = 0;
+    if constexpr (is_same_v<T, float>) 
+    {
+      mask = _mm512_cmp_ps_mask(_mm512_loadu_ps(b), _mm512_set1_ps(key), 
+                                _CMP_LT_OQ);
+    }
+    else if constexpr (is_same_v<T, double>) 
+    {
+      __m512d k = _mm512_set1_pd(key);
+      mask = _mm512_cmp_pd_mask(_mm512_loadu_pd(b), k, _CMP_LT_OQ)
+           | unsigned(_mm512_cmp_pd_mask(_mm512_loadu_pd(b + 8), k, 
+                                         _CMP_LT_OQ)) << 8;
+    }
+    else if constexpr (is_integral_v<T> and sizeof(T) == 4) 
+    {
+      __m512i v = _mm512_loadu_si512(b);
+      __m512i k = _mm512_set1_epi32(int(key));
+      mask = is_signed_v<T> ? _mm512_cmplt_epi32_mask(v, k) 
+                            : _mm512_cmplt_epu32_mask(v, k);
+    }
+    else if constexpr (is_integral_v<T> and sizeof(T) == 8) 
+    {
+      __m512i k = _mm512_set1_epi64((long long) key);
+      __m512i lo = _mm512_loadu_si512(b);
+      __m512i hi = _mm512_loadu_si512(b + 8);
+      if constexpr (is_signed_v<T>) 
+      {
+        mask = _mm512_cmplt_epi64_mask(lo, k) 
+             | unsigned(_mm512_cmplt_epi64_mask(hi, k)) << 8;
+      }
+      else 
+      {
+        mask = _mm512_cmplt_epu64_mask(lo, k) 
+             | unsigned(_mm512_cmplt_epu64_mask(hi, k)) << 8;
+      }
+    }
+    else 
+    {
+      return less(b, key);
+    }
+    return __builtin_popcount(mask);
+  }
+
+  __attribute__((target("avx512f")))
+  static size_t avx512(const T* index, const size_t* levels, size_t height, 
+                       const T* keys, size_t n, T key)
+  {
+    if (n == 0 or keys[n - 1] < key) 
+    {
+      return n;
+    }
+    size_t block = 0;
+    for (size_t l = 0; l < height; ++l) 
+    {
+      block = block * Block + less512(index + levels[l] + block * Block, key);
+    }
+    size_t first = block * Block;
+    if (first + Block <= n) 
+    {
+      return first + less512(keys + first, key);
+    }
+    return tail(keys, n, first, key);
+  }
+#endif
+};
+
+//
+// @brief Copie figee et triee des cles d'un arbre
+//
+// rendue par BinarySearchTree::freeze. Immuable, elle se lit sans
+// synchronisation depuis autant de threads que voulu, et ses cles sont
+// contigues sur le noeud NUMA demande.
+//
+template <typename T>
+class FrozenSnapshot
+{
+public:
+  using value_type = T;
+  using const_reference = const T&;
+  using Storage = vector<T, NodeLocalAllocator<T>>;
+
+  // cles numeriques : recherche dans un index de blocs (BlockSearch)
+  static constexpr bool indexed = is_arithmetic_v<T> and !is_same_v<T, bool>;
+
+private:
+  Storage _keys;          // croissantes, chaque cle d'un multi-ensemble
+                          // repetee selon sa multiplicite
+  Storage _index;         // niveaux superieurs de l'index, vide sinon
+  vector<size_t> _levels; // debut de chaque niveau dans _index
+
+public:
+  FrozenSnapshot() = default;
+
+  explicit FrozenSnapshot(Storage keys) 
+  : _keys(std::move(keys)), _index(_keys.get_allocator())
+  { 
+    buildIndex();
+  }
+
+  //
+  // @brief copie de other placee sur node
+  //
+  FrozenSnapshot(const FrozenSnapshot& other, int node) 
+  : _keys(other._keys.begin(), other._keys.end(), NodeLocalAllocator<T>(node)),
+    _index(other._index.begin(), other._index.end(), 
+           NodeLocalAllocator<T>(node)),
+    _levels(other._levels)
+  { }
+
+  //
+  // @brief limite les noyaux de recherche de toutes les copies figees de T
+  //        a level, ou au mieux de ce que le processeur permet
+  //
+  // A appeler avant de lancer les lecteurs, pour mesurer ou tester.
+  // @return le jeu d'instructions retenu
+  static SimdLevel setSimdLevel(SimdLevel level) noexcept
+  {
+    if constexpr (indexed) 
+    {
+      level = std::min(level, detectSimd());
+      search() = BlockSearch<T>::select(level);
+      return level;
+    }
+    else 
+    {
+      return SimdLevel::Scalar;
+    }
+  }
+
+  size_t size() const noexcept 
+  { 
+    return _keys.size(); 
+  }
+
+  int node() const noexcept 
+  { 
+    return _keys.get_allocator().node; 
+  }
+
+  //
+  // @brief position de la premiere cle non inferieure a key, size() si
+  //        toutes sont inferieures
+  //
+  // @remark Complexité O(log(n))
+  size_t lower_bound(const_reference key) const noexcept 
+  {
+    if constexpr (indexed) 
+    {
+      return search()(_index.data(), _levels.data(), _levels.size(), 
+                      _keys.data(), _keys.size(), key);
+    }
+    else 
+    {
+      return std::lower_bound(_keys.begin(), _keys.end(), key) - _keys.begin();
+    }
+  }
+
+  bool contains(const_reference key) const noexcept 
+  {
+    size_t i = lower_bound(key);
+    return i < _keys.size() and !(key < _keys[i]);
+  }
+
+  //
+  // @return la position de key, size_t(-1) si elle est absente, comme
+  //         BinarySearchTree::rank
+  size_t rank(const_reference key) const noexcept 
+  {
+    size_t i = lower_bound(key);
+    return i < _keys.size() and !(key < _keys[i]) ? i : size_t(-1);
+  }
+
+  //
+  // @exception std::logic_error si n >= size(), comme
+  //            BinarySearchTree::nth_element
+  const_reference nth_element(size_t n) const 
+  {
+    if (n >= _keys.size()) 
+    {
+      throw std::logic_error("logic_error_nth_element");
+    }
+    return _keys[n];
+  }
+
+private:
+  static typename BlockSearch<T>::Fn& search() noexcept
+  {
+    static typename BlockSearch<T>::Fn fn = BlockSearch<T>::select(detectSimd());
+    return fn;
+  }
+
+  //
+  // @brief construit les niveaux superieurs de l'index, du bas vers le haut
+  //
+  // chaque niveau est complete a un multiple de Block par sa derniere cle,
+  // la plus grande : elle n'est jamais inferieure a une cle cherchee qui
+  // n'excede pas la plus grande de l'arbre.
+  // @remark Complexité O(n / Block)
+  void buildIndex()
+  {
+    if constexpr (indexed) 
+    {
+      const size_t block = BlockSearch<T>::Block;
+      size_t n = _keys.size();
+      vector<vector<T>> levels;
+      vector<T> level;
+      for (size_t first = 0; n > block and first < n; first += block) 
+      {
+        level.push_back(_keys[std::min(first + block, n) - 1]);
+      }
+      while (!level.empty()) 
+      {
+        level.resize((level.size() + block - 1) / block * block, level.back());
+        vector<T> next;
+        if (level.size() > block) 
+        {
+          for (size_t last = block - 1; last < level.size(); last += block) 
+          {
+            next.push_back(level[last]);
+          }
+        }
+        levels.push_back(std::move(level));
+        level = std::move(next);
+      }
+      size_t total = 0;
+      for (const vector<T>& l : levels) 
+      {
+        total += l.size();
+      }
+      _index.reserve(total);
+      for (auto l = levels.rbegin(); l != levels.rend(); ++l) 
+      {
+        _levels.push_back(_index.size());
+        _index.insert(_index.end(), l->begin(), l->end());
+      }
+    }
+  }
+};
+
+//
+// @brief Prefixe de cle range dans les noeuds des arbres de std::string
+//
+// les 8 premiers octets de la cle, completes par des zeros et lus en
+// gros-boutiste : comparer deux prefixes comme des entiers non signes
+// ordonne les cles comme string::compare, sauf a egalite de prefixe.
+//
+template <bool Cached>
+struct KeyPrefix 
+{ };
+
+template <>
+struct KeyPrefix<true> 
+{
+  uint64_t prefix;
+};
+
+inline uint64_t packPrefix(const string& key) noexcept
+{
+  uint64_t prefix = 0;
+  memcpy(&prefix, key.data(), std::min<size_t>(key.size(), sizeof prefix));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  prefix = __builtin_bswap64(prefix);
+#endif
+  return prefix;
+}
+
+//
+// @brief Multiplicite des cles, rangee dans les noeuds des multi-ensembles
+//
+template <bool Counted, typename C>
+struct KeyCount 
+{ };
+
+template <typename C>
+struct KeyCount<true, C> 
+{
+  C count;
+};
+
+//
+// Avec Multiset = true, l'arbre est un multi-ensemble : une cle deja
+// presente voit sa multiplicite augmenter plutot que d'etre ignoree, et
+// deleteElement la diminue, ne retirant le noeud qu'a la derniere
+// occurrence. size, nbElements, rank, nth_element et les parcours comptent
+// chaque occurrence; rank donne la position de la premiere.
+//
+template <typename T, typename Stats = NoStats, bool Multiset = false>
+class BinarySearchTree 
+{
+public:
+  
+  using value_type = T;
+  using reference = T&;
+  using const_reference = const T&;
+  using stats_type = typename Stats::Snapshot;
+
+private:
+  /**
+   *  @brief Cles entieres : descentes sans branchement et noeud compact
+   *
+   * la comparaison d'entiers est sans effet de bord et peu couteuse : les
+   * descentes n'en font qu'une par niveau, choisissent le fils sans
+   * branchement et ne testent l'egalite qu'une fois en bas. Jusqu'a 4
+   * octets, la cle partage 8 octets avec un compte sur 32 bits (noeud de
+   * 24 octets au lieu de 32) et l'arbre est limite a 2^32 - 1 noeuds.
+   */
+  static constexpr bool integralKeys = is_integral_v<T>;
+  
+  using count_type = conditional_t<integralKeys and sizeof(T) <= 4, 
+                                   uint32_t, size_t>;
+  
+  /**
+   *  @brief Cles std::string : prefixe dans le noeud
+   *
+   * chaque noeud garde les 8 premiers octets de sa cle (KeyPrefix). Les
+   * descentes comparent d'abord les prefixes, sans lire le tampon de la
+   * chaine, et ne comparent les chaines qu'a egalite de prefixe. Le noeud
+   * de 64 octets est aligne sur une ligne de cache : un niveau de descente
+   * n'en touche qu'une, chaine courte (SSO) comprise.
+   */
+  static constexpr bool stringKeys = is_same_v<T, string>;
+  
+  /**
+   *  @brief Noeud de l'arbre.
+   *
+   * contient une cle et les liens vers les sous-arbres droit et gauche,
+   * ranges dans un tableau : une descente choisit son fils par l'indice
+   * child[node.key < key], sans branchement. left() et right() nomment
+   * les deux cases.
+   */
+  struct Node : KeyPrefix<stringKeys>, KeyCount<Multiset, count_type>
+  {
+    const value_type key; // clé non modifiable
+    count_type nbElements;// nombre de noeuds dans le sous arbre dont
+                          // ce noeud est la racine
+    Node* child[2];       // sous arbres avec des cles plus petites (0)
+                          // et plus grandes (1)
+    
+    Node(const_reference key)  // seul constructeur disponible. key est obligatoire
+    : key(key), nbElements(1), child{ nullptr, nullptr }
+    { 
+      if constexpr (stringKeys)
+      {
+        this->prefix = packPrefix(this->key);
+      }
+      if constexpr (Multiset)
+      {
+        this->count = 1;
+      }
+    }
+    
+    Node*& left() noexcept { return child[0]; }
+    Node*& right() noexcept { return child[1]; }
+    Node() = delete;             // pas de construction par défaut
+    Node(const Node&) = delete;  // pas de construction par copie
+    Node(Node&&) = delete;       // pas de construction par déplacement
+  };
+  
+  static constexpr size_t slotAlign = 
+    stringKeys and sizeof(Node) == 64 ? 64 : alignof(Node);
+  using Pool = NodePool<sizeof(Node), slotAlign>;
+  
+  /**
+   *  @brief  Racine de l'arbre. nullptr si l'arbre est vide
+   */
+  Node* _root;
+  
+  /**
+   *  @brief Observation des profondeurs pour le re-equilibrage automatique
+   *
+   *  contains observe aussi les profondeurs, sur un arbre const que
+   *  plusieurs lecteurs peuvent parcourir a la fois : les compteurs sont
+   *  atomiques, en ordre relaxed. Sous concurrence, une fenetre peut
+   *  compter quelques observations de trop ou de moins, sans course.
+   */
+  struct DepthWatch
+  {
+    RebalancePolicy policy;
+    atomic<size_t> observed{ 0 };   // observations dans la fenetre courante
+    atomic<size_t> violations{ 0 }; // dont trop profondes
+    atomic<bool> pending{ false };  // re-equilibrage a executer
+    
+    DepthWatch() = default;
+    
+    DepthWatch(const DepthWatch& other) noexcept : policy(other.policy), 
+      observed(other.observed.load(memory_order_relaxed)), 
+      violations(other.violations.load(memory_order_relaxed)), 
+      pending(other.pending.load(memory_order_relaxed)) 
+    { }
+    
+    DepthWatch& operator=(const DepthWatch& other) noexcept 
+    {
+      policy = other.policy;
+      observed.store(other.observed.load(memory_order_relaxed), 
+                     memory_order_relaxed);
+      violations.store(other.violations.load(memory_order_relaxed), 
+                       memory_order_relaxed);
+      pending.store(other.pending.load(memory_order_relaxed), 
+                    memory_order_relaxed);
+      return *this;
+    }
+    
+    // nouvelle fenetre, sans re-equilibrage en attente
+    void clear() noexcept 
+    {
+      observed.store(0, memory_order_relaxed);
+      violations.store(0, memory_order_relaxed);
+      pending.store(false, memory_order_relaxed);
+    }
+  };
+  
+  /**
+   *  @brief mutable : contains observe aussi les profondeurs
+   */
+  mutable DepthWatch _watch;
+  
+  /**
+   *  @brief Comptes tenus a jour par createNode et destroyNode
+   */
+  struct Footprint
+  {
+    size_t nodes = 0;
+    size_t keyHeap = 0;
+    // pierres tombales des multi-ensembles seulement : un noeud d'ensemble
+    // compte pour un element, si bien que tombstones() deduit les siennes
+    // de nodes - size(), et destroyNode ne saurait pas lire sa mort sur des
+    // comptes que les restructurations laissent perimes
+    size_t tombstones = 0;
+  };
+  Footprint _footprint;
+
+  
+  /**
+   *  @brief Memoire de tous les noeuds de l'arbre
+   */
+  Pool _pool;
+  
+  /**
+   *  @brief Noeuds extremes, pour min et max en O(1)
+   *
+   *  Les restructurations deplacent les liens, pas les noeuds ; seules
+   *  une insertion au-dela d'un extreme et la liberation du noeud les
+   *  oublient, et la meme operation les retrouve avec settleEnds. min et
+   *  max ne font que les lire : des lecteurs concurrents restent sans
+   *  ecriture.
+   */
+  struct Ends
+  {
+    Node* first = nullptr;
+    Node* last = nullptr;
+  };
+  Ends _ends;
+  
+  /**
+   *  @brief Suppression paresseuse, voir setLazyDeletion
+   */
+  struct LazyDeletion
+  {
+    bool enabled = false;
+    double maxDeadRatio = 0.25;
+  };
+  LazyDeletion _lazy;
+  
+  /**
+   *  @brief change a chaque liberation ou re-liaison de noeuds : les doigts
+   *         d'une autre epoque sont perimes
+   */
+  uint64_t _epoch = firstEpoch();
+  
+  //
+  // @brief epoque initiale propre a chaque arbre : un doigt ne peut pas
+  //        passer pour valide sur un autre arbre cree a la meme adresse
+  //
+  static uint64_t firstEpoch() noexcept 
+  {
+    static atomic<uint64_t> trees{ 0 };
+    return trees.fetch_add(1, memory_order_relaxed) << 32;
+  }
+  
+public:
+  /**
+   *  @brief Constructeur par défaut. Construit un arbre vide
+   *  @remark Complexité O(1)
+   */
+  BinarySearchTree() : _root(nullptr)
+  { }
+  
+  /**
+   *  @brief Construit un arbre vide re-equilibre selon policy
+   *  @remark Complexité O(1)
+   */
+  explicit BinarySearchTree(const RebalancePolicy& policy) : _root(nullptr)
+  { 
+      _watch.policy = policy;
+  }
+  
+  /**
+   *  @brief Constucteur de copie.
+   *
+   *  @param other le BinarySearchTree à copier
+   *  @remark Complexité O(1)
+   *
+   */
+  BinarySearchTree(BinarySearchTree& other) : _watch(other._watch)
+  {
+      try
+      {
+        typename Stats::Scope scope(TreeOp::Copy);
+        _root = nullptr;
+        _pool.setBacking(other._pool.backing());
+        copyNodes(_root, other._root);  
+        settleEnds();
+        _lazy = other._lazy;
+      }
+      catch(...)
+      {
+        deleteSubTree(_root);
+        throw;
+      }
+  }
+  
+  /**
+   * 
+   * @brief Fonction qui permet de copier tous les éléments d'un ABR
+   * 
+   * 
+   * @param r
+   * @param nodeToCopy
+   * 
+   * @remark Complexité 0(1)
+   */
+  void copyNodes(Node *& r, Node *nodeToCopy)
+  {
+        if (nodeToCopy) 
+        {
+            r = createNode(nodeToCopy->key);
+            r->nbElements = nodeToCopy->nbElements;
+            if constexpr (Multiset)
+            {
+                r->count = nodeToCopy->count;
+                if (!r->count) 
+                {
+                    _footprint.tombstones++;
+                }
+            }
+
+            copyNodes(r->left(), nodeToCopy->left());
+            copyNodes(r->right(), nodeToCopy->right());
+        }
+    }
+
+  
+  /**
+   *  @brief Opérateur d'affectation par copie.
+   *
+   *  @param other le BinarySearchTree à copier
+   *  @remark Compexité en moyenne en O(1)
+   */
+  BinarySearchTree& operator=(const BinarySearchTree& other) 
+  {
+        Node* tmp = nullptr;
+        try 
+        {
+            typename Stats::Scope scope(TreeOp::Copy);
+            _pool.setBacking(other._pool.backing());
+            copyNodes(tmp, other._root);
+            deleteSubTree(_root);
+            _root = tmp;
+            settleEnds();
+            _watch = other._watch;
+            _lazy = other._lazy;
+            _epoch++;
+        } 
+        catch (...) 
+        {
+            deleteSubTree(tmp);
+            throw;
+        }
+        return *this;
+  }
+  
+  /**
+   *  @brief Echange le contenu avec un autre BST
+   *
+   *  @param other le BST avec lequel on echange le contenu
+   *  @remark Compexité en moyenne en O(1)
+   */
+  void swap(BinarySearchTree& other) noexcept 
+  {
+      Node* tmp = other._root;
+      other._root = _root;
+      _root = tmp;
+      std::swap(_watch, other._watch);
+      std::swap(_footprint, other._footprint);
+      std::swap(_ends, other._ends);
+      std::swap(_lazy, other._lazy);
+      _epoch = other._epoch = std::max(_epoch, other._epoch) + 1;
+      _pool.swap(other._pool);
+  }
+  
+  /**
+   *  @brief constructeur de copie par déplacement
+   *
+   *  @param other le BST dont on vole le contenu
+    @remark Compexité en O(1)
+   *
+   */
+  BinarySearchTree(BinarySearchTree&& other) noexcept 
+  : _watch(other._watch), _footprint(other._footprint), 
+    _pool(std::move(other._pool)), _ends(other._ends), _lazy(other._lazy)
+  {
+      _root = other._root;
+      other._root = nullptr;
+      other._footprint = Footprint();
+      other._ends = Ends();
+      other._epoch++;
+  }
+  
+  /**
+   *  @brief Opérateur d'affectation par déplacement.
+   *
+   *  @param other le BST dont on vole le contenu
+   * @remark Compexité en moyenne en O(n)
+   */
+  BinarySearchTree& operator= ( BinarySearchTree&& other ) noexcept 
+{
+        Node* tmp = _root;
+        _root = other._root;
+        deleteSubTree(tmp);
+        other._root = nullptr;
+        _watch = other._watch;
+        _footprint = other._footprint;
+        other._footprint = Footprint();
+        _ends = other._ends;
+        other._ends = Ends();
+        _lazy = other._lazy;
+        _epoch = other._epoch = std::max(_epoch, other._epoch) + 1;
+        _pool = std::move(other._pool);
+        return *this;
+  }
+  
+  //
+  // @brief Destructeur
+  // @remark Compexité en moyenne en O(n)
+  // Ne pas modifier mais écrire la fonction
+  // récursive privée deleteSubTree(Node*)
+  //
+  ~BinarySearchTree() 
+  {
+    deleteSubTree( _root );
+  }
+  
+private:
+  //
+  // @brief Fonction détruisant (delete) un sous arbre
+  //
+  // @param r la racine du sous arbre à détruire.
+  //          peut éventuellement valoir nullptr
+  // @remark Compexité en moyenne en O(n)
+  // Itérative : une rotation à droite remonte chaque fils gauche, ce qui
+  // détruit aussi sans débordement de pile un arbre linéarisé.
+  void deleteSubTree(Node* r) noexcept 
+  {
+      while(r)
+      {
+          if (r->left()) 
+          {
+              Node* l = r->left();
+              r->left() = l->right();
+              l->right() = r;
+              r = l;
+          } 
+          else 
+          {
+              Node* next = r->right();
+              destroyNode(r);
+              r = next;
+          }
+      }
+  }
+  
+  //
+  // @brief Alloue un noeud de cle key
+  //
+  // toutes les allocations de noeuds passent par ici, ce qui tient a jour
+  // les comptes de memory_usage
+  // @remark Complexité O(1) plus la copie de la cle
+  Node* createNode(const_reference key)
+  {
+      void* slot = _pool.allocate();
+      Node* n;
+      try 
+      {
+          n = new (slot) Node(key);
+      }
+      catch (...) 
+      {
+          _pool.release(slot);
+          throw;
+      }
+      Stats::allocate();
+      BST_TRACE(node_alloc, n);
+      _footprint.nodes++;
+      _footprint.keyHeap += heap_usage(n->key);
+      return n;
+  }
+  
+  //
+  // @brief Libere un noeud alloue par createNode
+  //
+  void destroyNode(Node* n) noexcept
+  {
+      forget(n);
+      _epoch++;
+      if constexpr (Multiset)
+      {
+          if (!n->count) 
+          {
+              _footprint.tombstones--;
+          }
+      }
+      _footprint.nodes--;
+      _footprint.keyHeap -= heap_usage(n->key);
+      BST_TRACE(node_free, n);
+      n->~Node();
+      _pool.release(n);
+      Stats::release();
+  }
+
+  //
+  // @brief oublie n s'il est un noeud extreme memorise
+  //
+  void forget(const Node* n) noexcept
+  {
+      if (n == _ends.first) 
+      {
+          _ends.first = nullptr;
+      }
+      if (n == _ends.last) 
+      {
+          _ends.last = nullptr;
+      }
+  }
+
+  //
+  // @brief retrouve les extremes oublies, en fin d'operation
+  //
+  // @remark Complexité O(1) s'ils sont connus, O(h) sinon : seule une
+  //         operation qui a retire ou depasse un extreme paie la descente
+  void settleEnds() noexcept
+  {
+      if (size()) 
+      {
+          _ends.first = extreme<0>(_ends.first);
+          _ends.last = extreme<1>(_ends.last);
+      }
+  }
+
+public:
+  //
+  // @brief Insertion d'une cle dans l'arbre
+  //
+  // @param key la clé à insérer.
+  //
+  // Ne pas modifier mais écrire la fonction
+  // récursive privée insert(Node*&,const_reference)
+  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
+  void insert( const_reference key) {
+    typename Stats::Scope scope(TreeOp::Insert);
+    checkCapacity();
+    beyondEnds(key);
+    size_t depth = 0;
+    bool added = insert(_root,key,depth);
+    settleEnds();
+    if (added)
+    {
+        inserted(key, depth);
+    }
+  }
+  
+  //
+  // @brief Position memorisee dans l'arbre, pour insert(hint, key)
+  //
+  // le chemin depuis la racine jusqu'a un noeud : sans lien vers le
+  // parent, c'est lui qui permet de remonter. Chaque pas retient les
+  // ancetres les plus proches qui bornent les cles de son sous-arbre.
+  // Un doigt se perime des que l'arbre libere ou re-lie des noeuds ; il
+  // repart alors de la racine.
+  //
+  class Finger
+  {
+    friend class BinarySearchTree;
+    struct Step
+    {
+      Node* node;
+      int low;  // indice de l'ancetre borne inferieure, -1 sans borne
+      int high; // indice de l'ancetre borne superieure
+    };
+    vector<Step> path;
+    const BinarySearchTree* tree = nullptr;
+    uint64_t epoch = 0;
+  public:
+    bool empty() const noexcept { return path.empty(); }
+  };
+  
+  //
+  // @brief Insertion d'une cle a partir d'un doigt
+  //
+  // remonte le chemin de hint jusqu'au premier noeud dont le sous-arbre
+  // peut contenir key, puis redescend depuis lui : pour des cles presque
+  // triees, quelques comparaisons au lieu de h. Une cle plus grande que le
+  // maximum connu suit la branche droite sans comparaison. hint est
+  // ensuite place sur le noeud de key.
+  //
+  // @param hint doigt d'une insertion precedente, vide au depart
+  // @param key la cle a inserer
+  // @remark Complexité en O(log d) comparaisons pour une cle a distance d
+  //         du doigt ; les nbElements du chemin sont toujours mis a jour,
+  //         en O(h) mais sur des noeuds deja en cache
+  void insert(Finger& hint, const_reference key) 
+  {
+    typename Stats::Scope scope(TreeOp::Insert);
+    checkCapacity();
+    locate(hint, key);
+    // un nouvel extreme remplace l'ancien, sans redescendre
+    bool first = _ends.first and key < _ends.first->key;
+    bool last = _ends.last and _ends.last->key < key;
+    beyondEnds(key);
+    auto& path = hint.path;
+    Node* at = path.empty() ? nullptr : path.back().node;
+    if (at and !(key < at->key) and !(at->key < key)) 
+    {
+        if (Multiset or !live(at))
+        {
+            for (size_t i = 0; i + 1 < path.size(); ++i) 
+            {
+                path[i].node->nbElements++;
+            }
+            addOccurrence(at);
+        }
+        // une pierre tombale ranimee au-dela d'un extreme le remplace
+        settleEnds();
+        return;
+    }
+    Node* n = createNode(key);
+    (at ? at->child[at->key < key] : _root) = n;
+    for (auto& step : path) 
+    {
+        step.node->nbElements++;
+    }
+    push(hint, n, at and at->key < key);
+    if (first or size() == 1) 
+    {
+        _ends.first = n;
+    }
+    if (last or size() == 1) 
+    {
+        _ends.last = n;
+    }
+    inserted(key, path.size());
+  }
+  
+private:
+  void checkCapacity() const 
+  {
+    if constexpr (sizeof(count_type) < sizeof(size_t))
+    {
+        if (size() == numeric_limits<count_type>::max())
+        {
+            throw length_error("BinarySearchTree::insert");
+        }
+    }
+  }
+  
+  //
+  // @brief une cle au-dela d'un extreme connu en devient un
+  //
+  void beyondEnds(const_reference key) noexcept 
+  {
+    if (_ends.first and key < _ends.first->key) 
+    {
+        _ends.first = nullptr;
+    }
+    if (_ends.last and _ends.last->key < key) 
+    {
+        _ends.last = nullptr;
+    }
+  }
+  
+  //
+  // @brief re-equilibrage apres l'ajout d'un noeud a la profondeur depth
+  //
+  void inserted(const_reference key, size_t depth) 
+  {
+    if (_watch.policy.mode != RebalanceMode::Off)
+    {
+        bool deep = tooDeep(depth);
+        if (deep and _watch.policy.mode == RebalanceMode::Amortized)
+        {
+            rebuildScapegoat(key);
+            deep = false;
+        }
+        observe(deep);
+        rebalanceIfPending();
+    }
+  }
+  
+  //
+  // @brief place f sur le noeud de key, ou sur le dernier noeud du chemin
+  //        de key s'il est absent
+  //
+  // un doigt perime repart de la racine, ou de la branche droite si key
+  // depasse le maximum connu. Sinon on remonte : un pas dont une borne
+  // exclut key renvoie directement a l'ancetre de cette borne.
+  //
+  void locate(Finger& f, const_reference key) const 
+  {
+    auto& path = f.path;
+    if (f.tree != this or f.epoch != _epoch or path.empty()) 
+    {
+        f.tree = this;
+        f.epoch = _epoch;
+        path.clear();
+        if (_ends.last and _ends.last->key < key and 
+            !tombstones()) 
+        {
+            // ajout en fin : la branche droite, sans comparaison
+            Stats::compare();
+            for (Node* n = _root; n; n = n->right()) 
+            {
+                push(f, n, true);
+            }
+            return;
+        }
+    }
+    else 
+    {
+        // a droite du doigt, seules les bornes superieures peuvent exclure
+        // key : les inferieures des ancetres sont sous la cle du doigt
+        int i = int(path.size()) - 1;
+        Stats::compare();
+        if (path[i].node->key < key) 
+        {
+            for (int h; (h = path[i].high) >= 0 and 
+                        (Stats::compare(), !(key < path[h].node->key)); ) 
+            {
+                i = h;
+            }
+        } 
+        else 
+        {
+            for (int l; (l = path[i].low) >= 0 and 
+                        (Stats::compare(), !(path[l].node->key < key)); ) 
+            {
+                i = l;
+            }
+        }
+        path.resize(size_t(i) + 1);
+    }
+    while (true) 
+    {
+        Node* n = _root;
+        bool right = false;
+        if (!path.empty()) 
+        {
+            Node* b = path.back().node;
+            Stats::compare();
+            if (key < b->key) 
+            {
+                n = b->left();
+            } 
+            else if (Stats::compare(), b->key < key) 
+            {
+                n = b->right();
+                right = true;
+            } 
+            else 
+            {
+                return;
+            }
+        }
+        if (!n) 
+        {
+            return;
+        }
+        push(f, n, right);
+    }
+  }
+  
+  //
+  // @brief ajoute au doigt f le noeud n, fils droit ou gauche du dernier
+  //
+  static void push(Finger& f, Node* n, bool right) 
+  {
+    Stats::visit();
+    auto& path = f.path;
+    if (path.empty()) 
+    {
+        path.push_back({ n, -1, -1 });
+        return;
+    }
+    int parent = int(path.size()) - 1;
+    const auto& p = path.back();
+    path.push_back({ n, right ? parent : p.low, right ? p.high : parent });
+  }
+  
+public:
+  //
+  // @brief Curseur de lecture qui se souvient de sa derniere position
+  //
+  // seek(key) repart de la position precedente, comme insert(hint, key) :
+  // pour des cles voisines (jointure par fusion, sondes chronologiques),
+  // la remontee et la redescente ne couvrent que la distance parcourue.
+  // Comme un iterateur, il devient invalide des que l'arbre libere ou
+  // re-lie des noeuds ; seek le repositionne alors depuis la racine. Une
+  // suppression paresseuse de sa cle ne deplace rien : le curseur n'est
+  // plus valide, mais next passe encore a la cle suivante.
+  //
+  class Cursor
+  {
+    const BinarySearchTree* _tree;
+    Finger _finger;
+  public:
+    explicit Cursor(const BinarySearchTree& tree) noexcept : _tree(&tree) 
+    { }
+    
+    //
+    // @brief place le curseur sur la plus petite cle >= key
+    //
+    // @return faux s'il n'y en a pas ; le curseur est alors invalide
+    // @remark Complexité en O(log d) pour une cle a distance d de la
+    //         position precedente dans un arbre equilibre, O(h) au pire
+    bool seek(const_reference key) 
+    {
+        typename Stats::Scope scope(TreeOp::Contains);
+        _tree->locate(_finger, key);
+        auto& path = _finger.path;
+        if (!path.empty() and path.back().node->key < key) 
+        {
+            // key serait a droite du dernier noeud : son successeur est
+            // l'ancetre de sa borne superieure
+            up();
+        }
+        skipDead();
+        return valid();
+    }
+    
+    //
+    // @brief avance a la cle suivante, par ordre croissant
+    //
+    // @return faux au-dela de la plus grande cle
+    // @remark Complexité O(1) amortie sur un parcours
+    bool next() 
+    {
+        if (!placed()) 
+        {
+            return false;
+        }
+        typename Stats::Scope scope(TreeOp::Contains);
+        step();
+        skipDead();
+        return valid();
+    }
+    
+    // faux aussi si la cle du curseur a ete supprimee paresseusement
+    bool valid() const noexcept 
+    {
+        return placed() and live(_finger.path.back().node);
+    }
+    
+    //
+    // @exception std::logic_error si le curseur n'est pas valide
+    const_reference key() const 
+    {
+        if (!valid()) 
+        {
+            throw std::logic_error("logic_error_cursor");
+        }
+        return _finger.path.back().node->key;
+    }
+    
+  private:
+    // le chemin du curseur tient encore dans l'arbre
+    bool placed() const noexcept 
+    {
+        return !_finger.path.empty() and _finger.epoch == _tree->_epoch;
+    }
+    
+    void up() noexcept 
+    {
+        int high = _finger.path.back().high;
+        _finger.path.resize(size_t(high + 1));
+    }
+    
+    // successeur dans l'ordre symetrique : le minimum du fils droit, ou
+    // l'ancetre borne superieure
+    void step() 
+    {
+        Node* r = _finger.path.back().node->right();
+        if (!r) 
+        {
+            up();
+            return;
+        }
+        for (bool right = true; r; r = r->left(), right = false) 
+        {
+            push(_finger, r, right);
+        }
+    }
+    
+    void skipDead() 
+    {
+        while (!_finger.path.empty() and !live(_finger.path.back().node)) 
+        {
+            step();
+        }
+    }
+  };
+  
+  Cursor cursor() const noexcept 
+  {
+    return Cursor(*this);
+  }
+  
+  
+private:
+  //
+  // @brief Insertion d'une cle dans un sous-arbre
+  //
+  // @param r la racine du sous-arbre dans lequel
+  //          insérer la cle.
+  // @param key la clé à insérer.
+  // @param depth incremente du nombre de niveaux parcourus, le nouveau
+  //              noeud compris
+  //
+  // @return vrai si la cle est inseree. faux si elle etait deja presente.
+  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
+  // Si la cle est deja presente, cette fonction ne fait rien.
+  // x peut éventuellement valoir nullptr en entrée.
+  // la fonction peut modifier x, reçu par référence, si nécessaire
+  //
+  bool insert(Node*& r, const_reference key, size_t& depth) 
+  {
+    if constexpr (integralKeys)
+    {
+        return insertIntegral(r, key, depth);
+    }
+    else if constexpr (stringKeys)
+    {
+        return insertString(r, key, depth);
+    }
+    else
+    {
+        depth++;
+        if (!r)
+        {
+            r = createNode(key); 
+            return true;
+        }
+        Stats::visit();
+        Stats::compare();
+        if (key < r->key)
+        {    
+            if(!insert(r->left(), key, depth))
+            {
+                return false;
+            }
+        }
+        else if (Stats::compare(), key > r->key)
+        {
+            if(!insert(r->right(), key, depth))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            if (Multiset or !live(r))
+            {
+                addOccurrence(r);
+                return true;
+            }
+            return false;
+        }
+        r->nbElements++;
+        return true;
+    }
+  }
+  
+  //
+  // @brief insert sans branchement pour les cles entieres
+  //
+  // descend en retenant le dernier noeud de cle inferieure ou egale a key,
+  // puis, si ce n'est pas key, accroche le nouveau noeud et redescend le
+  // meme chemin, deja en cache, pour incrementer les comptes.
+  //
+  bool insertIntegral(Node*& r, const_reference key, size_t& depth) 
+  {
+    Node** link = &r;
+    Node* candidate = nullptr;
+    while (*link)
+    {
+        depth++;
+        Stats::visit();
+        Stats::compare();
+        Node* n = *link;
+        bool right = n->key <= key;
+        candidate = right ? n : candidate;
+        link = &n->child[right];
+    }
+    if (candidate and candidate->key == key)
+    {
+        if (Multiset or !live(candidate))
+        {
+            for (Node* n = r; n != candidate; n = n->child[n->key < key])
+            {
+                n->nbElements++;
+            }
+            addOccurrence(candidate);
+            return true;
+        }
+        return false;
+    }
+    depth++;
+    Node* created = createNode(key);
+    *link = created;
+    for (Node* n = r; n != created; n = n->child[n->key < key])
+    {
+        n->nbElements++;
+    }
+    return true;
+  }
+  
+  //
+  // @brief insert des cles std::string, par prefixes
+  //
+  // les comptes sont incrementes en descendant, puis retablis si key est
+  // deja presente ou si son noeud ne peut etre cree. Les descentes des
+  // cles std::string branchent plutot que d'indexer child : a egalite de
+  // prefixe, le resultat de la comparaison attend le tampon de la chaine,
+  // et seul un branchement predit laisse le noeud suivant se charger
+  // pendant ce temps.
+  //
+  bool insertString(Node*& r, const_reference key, size_t& depth) 
+  {
+    uint64_t prefix = packPrefix(key);
+    Node** link = &r;
+    while (*link)
+    {
+        depth++;
+        Stats::visit();
+        Node* n = *link;
+        int c = order(key, prefix, n);
+        if (c == 0)
+        {
+            if (Multiset or !live(n))
+            {
+                addOccurrence(n);
+                return true;
+            }
+            uncount(r, n, key, prefix);
+            return false;
+        }
+        n->nbElements++;
+        link = c < 0 ? &n->left() : &n->right();
+    }
+    depth++;
+    try
+    {
+        *link = createNode(key);
+    }
+    catch (...)
+    {
+        uncount(r, nullptr, key, prefix);
+        throw;
+    }
+    return true;
+  }
+  
+  // decremente les comptes du chemin de key, de r jusqu'a end exclu
+  static void uncount(Node* r, Node* end, const_reference key, 
+                      uint64_t prefix) noexcept
+  {
+      while (r != end)
+      {
+          r->nbElements--;
+          r = order(key, prefix, r) < 0 ? r->left() : r->right();
+      }
+  }
+  
+  //
+  // @brief ordre de key par rapport a la cle de n, comme string::compare
+  //
+  // les prefixes suffisent sauf s'ils sont egaux : on ne compare alors que
+  // la suite des chaines, ou les chaines entieres si l'une est courte.
+  //
+  static int order(const_reference key, uint64_t prefix, const Node* n) noexcept
+  {
+      Stats::compare();
+      if (prefix != n->prefix)
+      {
+          return prefix < n->prefix ? -1 : 1;
+      }
+      size_t common = std::min(key.size(), n->key.size());
+      if (common > sizeof prefix)
+      {
+          int c = memcmp(key.data() + sizeof prefix, 
+                         n->key.data() + sizeof prefix, common - sizeof prefix);
+          if (c != 0)
+          {
+              return c;
+          }
+      }
+      return key.size() < n->key.size() ? -1 : key.size() > n->key.size();
+  }
+  
+public:
+  //
+  // @brief Recherche d'une cle.
+  //
+  // @param key la cle a rechercher
+  //
+  // @return vrai si la cle trouvee, faux sinon.
+  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
+  //
+  // Ne pas modifier mais écrire la fonction
+  // récursive privée contains(Node*,const_reference)
+  //
+  // Avec une politique de re-equilibrage, la profondeur atteinte est
+  // observee dans des compteurs atomiques : des appels concurrents sur un
+  // arbre const restent surs.
+  //
+  bool contains( const_reference key ) const noexcept 
+  {
+    typename Stats::Scope scope(TreeOp::Contains);
+    size_t depth = 0;
+    bool found = contains(_root,key,depth);
+    if (_watch.policy.mode != RebalanceMode::Off)
+    {
+        observe(tooDeep(depth));
+    }
+    return found;
+  }
+  
+private:
+  //
+  // @brief Recherche d'une cle dans un sous-arbre
+  //
+  // @param key la cle a rechercher
+  // @param r   la racine du sous-arbre
+  // @param depth incremente du nombre de noeuds visites
+  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
+  // @return vrai si la cle trouvee, faux sinon.
+  //
+  static bool contains(Node* r, const_reference key, size_t& depth) noexcept 
+  {
+      if constexpr (integralKeys)
+      {
+          // le dernier noeud de cle inferieure ou egale a key est key s'il
+          // est present
+          Node* candidate = nullptr;
+          while (r)
+          {
+              depth++;
+              Stats::visit();
+              Stats::compare();
+              bool right = r->key <= key;
+              candidate = right ? r : candidate;
+              r = r->child[right];
+          }
+          return candidate and candidate->key == key and live(candidate);
+      }
+      else if constexpr (stringKeys)
+      {
+          uint64_t prefix = packPrefix(key);
+          while (r)
+          {
+              depth++;
+              Stats::visit();
+              int c = order(key, prefix, r);
+              if (c < 0)
+              {
+                  r = r->left();
+              }
+              else if (c > 0)
+              {
+                  r = r->right();
+              }
+              else
+              {
+                  return live(r);
+              }
+          }
+          return false;
+      }
+      else
+      {
+          if (!r)
+          {
+              return false;
+          }
+          depth++;
+          Stats::visit();
+          Stats::compare();
+          if (key < r->key)
+          {
+              return contains(r->left(), key, depth);
+          }
+          else if (Stats::compare(), key > r->key)
+          {
+              return contains(r->right(), key, depth);
+          }
+          else
+          {
+              return live(r);
+          }
+      }
+  }
+  
+public:
+  //
+  // @brief Recherche de la cle minimale.
+  //
+  // @return une const reference a la cle minimale
+  //
+  // @exception std::logic_error si necessaire
+  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
+  // vous pouvez mettre en oeuvre de manière iterative ou recursive a choix
+  //
+  // @remark Complexité O(1) : les modifications tiennent le minimum a jour
+  const_reference min() const 
+  {
+    typename Stats::Scope scope(TreeOp::Min);
+    if (size() == 0)
+    {
+        throw std::logic_error("logic_error_min");
+    }
+    return extreme<0>(_ends.first)->key;
+  }
+
+  //
+  // @brief Le plus grand element de l'arbre
+  //
+  // @exception std::logic_error si l'arbre est vide
+  // @remark Complexité O(1), comme min avec qui il compte dans les
+  //         statistiques
+  const_reference max() const 
+  {
+    typename Stats::Scope scope(TreeOp::Min);
+    if (size() == 0)
+    {
+        throw std::logic_error("logic_error_max");
+    }
+    return extreme<1>(_ends.last)->key;
+  }
+
+private:
+  //
+  // @brief noeud extreme du cote side (0 a gauche, 1 a droite) : cached
+  //        s'il est connu, retrouve sans le memoriser sinon
+  //
+  // descend la branche du cote side tant qu'elle a des elements vivants :
+  // sans noeud mort, c'est la branche jusqu'a la feuille.
+  //
+  template <int side>
+  Node* extreme(Node* cached) const noexcept 
+  {
+    if (cached) 
+    {
+        return cached;
+    }
+    Node* tmpNode = _root;
+    Stats::visit();
+    while (size(tmpNode->child[side]) or !live(tmpNode))
+    {
+        tmpNode = tmpNode->child[size(tmpNode->child[side]) ? side 
+                                                            : 1 - side];
+        Stats::visit();
+    }
+    return tmpNode;
+  }
+
+public:
+
+  //
+  // @brief les k plus petits elements, par ordre croissant
+  //
+  // parcours symetrique arrete apres k elements : seuls la branche gauche
+  // et les noeuds emis sont visites. Un element present plusieurs fois
+  // (multiensemble) est emis autant de fois.
+  //
+  // @param out iterateur de sortie, par exemple back_inserter(v)
+  // @return out apres le dernier element ecrit, moins de k si size() < k
+  // @remark Complexité en O(h + k)
+  template <typename OutputIt>
+  OutputIt bottom_k(size_t k, OutputIt out) const 
+  {
+      typename Stats::Scope scope(TreeOp::Min);
+      return firstK<0>(k, out);
+  }
+
+  //
+  // @brief les k plus grands elements, par ordre decroissant
+  //
+  // @remark Complexité en O(h + k)
+  template <typename OutputIt>
+  OutputIt top_k(size_t k, OutputIt out) const 
+  {
+      typename Stats::Scope scope(TreeOp::Min);
+      return firstK<1>(k, out);
+  }
+
+private:
+  //
+  // @brief parcours symetrique iteratif qui commence du cote side (0 a
+  //        gauche, 1 a droite) et s'arrete apres k elements
+  //
+  template <int side, typename OutputIt>
+  OutputIt firstK(size_t k, OutputIt out) const 
+  {
+      vector<Node*> stack;
+      Node* n = _root;
+      while (k and (n or !stack.empty())) 
+      {
+          for (; n; n = n->child[side]) 
+          {
+              Stats::visit();
+              stack.push_back(n);
+          }
+          n = stack.back();
+          stack.pop_back();
+          for (size_t w = weight(n); w and k; --w, --k) 
+          {
+              *out++ = n->key;
+          }
+          n = n->child[1 - side];
+      }
+      return out;
+  }
+
+public:
+  //
+  // @brief Supprime le plus petit element de l'arbre.
+  //
+  // @exception std::logic_error si necessaire
+  //
+  // vous pouvez mettre en oeuvre de manière iterative ou recursive a choix
+  // @remark Compexité en moyenne en O(log(n))
+  void deleteMin() 
+  {
+      typename Stats::Scope scope(TreeOp::DeleteMin);
+      if (tombstones()) 
+      {
+          // le noeud le plus a gauche peut etre mort
+          if (size() == 0) 
+          {
+              throw logic_error("std::Logic_error");
+          }
+          eraseRanks(0, 1);
+          return;
+      }
+      bool repeated = false;
+      if constexpr (Multiset)
+      {
+          // une seule occurrence du minimum s'il en a plusieurs
+          Node* min = _root;
+          while (min and min->left())
+          {
+              min = min->left();
+          }
+          if (min and min->count > 1)
+          {
+              for (Node* n = _root; n != min; n = n->left())
+              {
+                  n->nbElements--;
+              }
+              eraseOne(min);
+              repeated = true;
+          }
+      }
+      if (!repeated) 
+      {
+          destroyNode(removeMinAndReturnIt(_root));
+      }
+      settleEnds();
+      purgeIfNeeded();
+      rebalanceIfPending();
+  }
+  
+  //
+  // @brief Supprime le plus grand element de l'arbre, une seule
+  //        occurrence s'il en a plusieurs
+  //
+  // @exception std::logic_error si l'arbre est vide
+  // @remark Complexité en O(h) : sans lien vers le parent, les comptes de
+  //         la branche droite sont mis a jour en la descendant
+  void deleteMax() 
+  {
+      typename Stats::Scope scope(TreeOp::DeleteMin);
+      if (size() == 0) 
+      {
+          throw logic_error("logic_error_deleteMax");
+      }
+      if (tombstones()) 
+      {
+          eraseRanks(size() - 1, size());
+          return;
+      }
+      Node** cur = &_root;
+      while ((*cur)->right()) 
+      {
+          Stats::visit();
+          (*cur)->nbElements--;
+          cur = &(*cur)->right();
+      }
+      Stats::visit();
+      // le maximum n'a pas de fils droit : removeNode le remplace par
+      // son fils gauche
+      eraseOne(*cur);
+      settleEnds();
+      purgeIfNeeded();
+      rebalanceIfPending();
+  }
+  
+  //
+  // @brief Detache le plus petit element d'un sous arbre
+  //
+  // @param leaf la racine du sous arbre, modifiee si c'est elle le minimum
+  //
+  // @return le noeud detache, que l'appelant doit liberer ou recycler
+  //
+  // @exception std::logic_error si le sous arbre est vide
+  // @remark Compexité en moyenne en O(log(n))
+  static Node* removeMinAndReturnIt(Node*& leaf)
+  {
+      if (leaf == nullptr) 
+      {
+         throw logic_error("std::Logic_error");
+      }
+
+      Node** cur = &leaf;
+      while ((*cur)->left()) 
+      {
+          Stats::visit();
+          cur = &(*cur)->left();
+      }
+      Stats::visit();
+      Node* min = *cur;
+      // les ancetres perdent toutes les occurrences du minimum
+      for (Node* n = leaf; n != min; n = n->left())
+      {
+          n->nbElements -= weight(min);
+      }
+      *cur = min->right();
+      
+      return min;
+   }
+
+  //
+  // @brief Supprime les k plus petits elements de l'arbre en une passe
+  //
+  // descend une seule fois le long de la branche gauche : un sous-arbre
+  // gauche entierement retire est libere d'un bloc, et les ancetres ne
+  // sont mis a jour qu'une fois, au lieu de k appels a deleteMin.
+  //
+  // @return le nombre d'elements retires, min(k, size())
+  // @remark Complexité en O(h + k)
+  size_t pop_min_k(size_t k) 
+  {
+      typename Stats::Scope scope(TreeOp::DeleteMin);
+      k = std::min(k, size());
+      dropEnd<0>(_root, k);
+      settleEnds();
+      purgeIfNeeded();
+      rebalanceIfPending();
+      return k;
+  }
+  
+  //
+  // @brief Supprime l'element en position n dans l'ordre croissant, une
+  //        seule occurrence d'une cle repetee
+  //
+  // la position est trouvee avec nbElements, sans comparer de cles.
+  //
+  // @exception std::logic_error si n >= size()
+  // @remark Complexité en O(h)
+  void erase_nth(size_t n) 
+  {
+      if (n >= size()) 
+      {
+          throw std::logic_error("logic_error_erase_nth");
+      }
+      erase_rank_range(n, n + 1);
+  }
+  
+  //
+  // @brief Supprime les elements des positions [i, j) de l'ordre croissant
+  //
+  // descend par les nbElements jusqu'au premier noeud dans l'intervalle,
+  // puis retire la fin de son sous-arbre gauche et le debut du droit comme
+  // pop_min_k ; les comptes des ancetres baissent de j - i en descendant.
+  // Garder les N premiers d'un classement : erase_rank_range(N, size()).
+  //
+  // @return le nombre d'elements supprimes, j est ramene a size()
+  // @remark Complexité en O(h + k) pour k elements supprimes
+  size_t erase_rank_range(size_t i, size_t j) 
+  {
+      typename Stats::Scope scope(TreeOp::DeleteElement);
+      return eraseRanks(i, j);
+  }
+  
+private:
+  size_t eraseRanks(size_t i, size_t j) 
+  {
+      j = std::min(j, size());
+      if (i >= j) 
+      {
+          return 0;
+      }
+      size_t removed = j - i;
+      Node** cur = &_root;
+      while (true) 
+      {
+          Node* n = *cur;
+          Stats::visit();
+          size_t s = size(n->left());
+          size_t w = weight(n);
+          if (j <= s) 
+          {
+              n->nbElements -= removed;
+              cur = &n->left();
+          } 
+          else if (i >= s + w) 
+          {
+              n->nbElements -= removed;
+              cur = &n->right();
+              i -= s + w;
+              j -= s + w;
+          } 
+          else 
+          {
+              // n est dans l'intervalle
+              size_t fromLeft = i < s ? s - i : 0;
+              size_t fromRight = j > s + w ? j - s - w : 0;
+              dropEnd<1>(n->left(), fromLeft);
+              dropEnd<0>(n->right(), fromRight);
+              size_t own = removed - fromLeft - fromRight;
+              if constexpr (Multiset)
+              {
+                  if (own < w) 
+                  {
+                      n->count -= own;
+                      n->nbElements -= removed;
+                      break;
+                  }
+              }
+              *cur = join(n->left(), n->right());
+              destroyNode(n);
+              break;
+          }
+      }
+      settleEnds();
+      purgeIfNeeded();
+      rebalanceIfPending();
+      return removed;
+  }
+  
+private:
+  //
+  // @brief Supprime les k plus petits (side 0) ou plus grands (side 1)
+  //        elements du sous-arbre r, k <= size(r)
+  //
+  // descend une seule fois la branche du cote side : un sous-arbre
+  // entierement retire est libere d'un bloc, et chaque noeud traverse
+  // n'est mis a jour qu'une fois.
+  // @remark Complexité en O(h + k)
+  template <int side>
+  void dropEnd(Node*& r, size_t k) noexcept 
+  {
+      Node** cur = &r;
+      while (k) 
+      {
+          Node* n = *cur;
+          Stats::visit();
+          size_t s = size(n->child[side]);
+          if (k < s) 
+          {
+              n->nbElements -= k;
+              cur = &n->child[side];
+              continue;
+          }
+          deleteSubTree(n->child[side]);
+          n->child[side] = nullptr;
+          n->nbElements -= s;
+          k -= s;
+          if (!k) 
+          {
+              break;
+          }
+          if constexpr (Multiset)
+          {
+              if (k < n->count) 
+              {
+                  // quelques occurrences seulement de la cle extreme
+                  n->count -= k;
+                  n->nbElements -= k;
+                  break;
+              }
+          }
+          k -= weight(n);
+          *cur = n->child[1 - side];
+          destroyNode(n);
+      }
+  }
+  
+public:
+  
+  
+  //
+  // @brief Supprime l'element de cle key de l'arbre.
+  //
+  // @param key l'element a supprimer
+  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
+  // si l'element n'est pas present, la fonction ne modifie pas
+  // l'arbre mais retourne false. Si l'element est present, elle
+  // retourne vrai
+  //
+  // Ne pas modifier mais écrire la fonction
+  // récursive privée deleteElement(Node*&,const_reference)
+  //
+  bool deleteElement( const_reference key) noexcept 
+  {
+    typename Stats::Scope scope(TreeOp::DeleteElement);
+    bool deleted = deleteElement( _root, key );
+    settleEnds();
+    purgeIfNeeded();
+    rebalanceIfPending();
+    return deleted;
+  }
+  
+  //
+  // @brief Supprime tous les elements de l'intervalle [lo, hi)
+  //
+  // une descente jusqu'au premier noeud de l'intervalle coupe l'arbre en
+  // deux : son sous-arbre gauche garde les cles < lo, le droit celles
+  // >= hi. Chaque cote est elague le long d'un seul chemin, les
+  // sous-arbres entierement dans l'intervalle sont liberes d'un bloc, puis
+  // les deux restes sont recolles sous le successeur. Les comptes des
+  // ancetres ne sont mis a jour qu'une fois.
+  //
+  // @return le nombre d'elements supprimes, occurrences comprises
+  // @remark Complexité en O(h + k) pour k elements supprimes, au lieu de
+  //         k appels a deleteElement
+  size_t erase_range(const_reference lo, const_reference hi) 
+  {
+    typename Stats::Scope scope(TreeOp::DeleteElement);
+    if (!(lo < hi)) 
+    {
+        return 0;
+    }
+    vector<Node*> path;
+    Node** cur = &_root;
+    while (*cur) 
+    {
+        Node* n = *cur;
+        Stats::visit();
+        Stats::compare();
+        if (n->key < lo) 
+        {
+            cur = &n->right();
+        } 
+        else if (!(n->key < hi)) 
+        {
+            cur = &n->left();
+        } 
+        else 
+        {
+            break;
+        }
+        path.push_back(n);
+    }
+    size_t removed = 0;
+    if (Node* n = *cur) 
+    {
+        removed = weight(n);
+        removed += trim<0>(n->left(), lo) + trim<1>(n->right(), hi);
+        *cur = join(n->left(), n->right());
+        destroyNode(n);
+    }
+    for (Node* p : path) 
+    {
+        p->nbElements -= removed;
+    }
+    settleEnds();
+    purgeIfNeeded();
+    rebalanceIfPending();
+    return removed;
+  }
+  
+private:
+  //
+  // @brief Elague le sous-arbre r : garde les cles < bound si keep vaut 0,
+  //        les cles >= bound si keep vaut 1
+  //
+  // un noeud ecarte part avec tout son sous-arbre du cote ecarte, libere
+  // d'un bloc ; la descente continue dans l'autre.
+  //
+  // @return le nombre d'elements supprimes
+  // @remark Complexité en O(h + k)
+  template <int keep>
+  size_t trim(Node*& r, const_reference bound) noexcept 
+  {
+    // noeuds gardes et elements deja supprimes quand on les a traverses :
+    // seules les suppressions suivantes sont sous eux
+    vector<pair<Node*, size_t>> path;
+    size_t removed = 0;
+    Node** cur = &r;
+    while (*cur) 
+    {
+        Node* n = *cur;
+        Stats::visit();
+        Stats::compare();
+        if ((n->key < bound) == (keep == 0)) 
+        {
+            path.emplace_back(n, removed);
+            cur = &n->child[1 - keep];
+        } 
+        else 
+        {
+            Node* kept = n->child[keep];
+            removed += n->nbElements - size(kept);
+            n->child[keep] = nullptr;
+            deleteSubTree(n);
+            *cur = kept;
+        }
+    }
+    for (auto& [n, before] : path) 
+    {
+        n->nbElements -= removed - before;
+    }
+    return removed;
+  }
+  
+  //
+  // @brief Recolle deux sous-arbres dont toutes les cles de l sont
+  //        inferieures a celles de r, sous le minimum de r
+  //
+  // @remark Complexité en O(h)
+  static Node* join(Node* l, Node* r) noexcept 
+  {
+    if (!l or !r) 
+    {
+        return l ? l : r;
+    }
+    Node* m = removeMinAndReturnIt(r);
+    size_t w = weight(m);
+    m->left() = l;
+    m->right() = r;
+    m->nbElements = size(l) + size(r) + w;
+    Stats::restructure();
+    return m;
+  }
+  
+private:
+  //
+  // @brief Supprime l'element de cle key du sous arbre.
+  //
+  // @param r la racine du sous arbre
+  // @param key l'element a supprimer
+  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
+  // si l'element n'est pas present, la fonction ne modifie pas
+  // l'arbre mais retourne false. Si l'element est present, elle
+  // retourne vrai
+    bool deleteElement(Node*& r, const_reference key) noexcept
+    {
+        if constexpr (integralKeys)
+        {
+            return deleteIntegral(r, key);
+        }
+        else if constexpr (stringKeys)
+        {
+            return deleteString(r, key);
+        }
+        else
+        {
+            if (r) 
+            {
+                Stats::visit();
+                Stats::compare();
+                if (key < r->key) // key recherchée inférieure au noeud actuel, on va
+                { // chercher à gauche
+                    if (deleteElement(r->left(), key)) // si on trouve la clé
+                    {
+                        r->nbElements--;
+                        return true;
+                    } 
+                    else 
+                    {
+                        return false;
+                    }
+                } 
+                else if (Stats::compare(), key > r->key) // key recherchée supérieure au noeud actuel, on
+                { // va vers la droite
+                    if (deleteElement(r->right(), key)) // si on a trouvé la clé
+                    {
+                        r->nbElements--;
+                        return true;
+                    } 
+                    else 
+                    {
+                        return false;
+                    }
                 } 
+                else if (!live(r)) // deja morte
+                {
+                    return false;
+                }
                 else 
+                { 
+                    eraseOne(r); // on a la key
+                    return true;
+                }
+            } 
+            else 
+            { 
+                return false;
+            }
+        }
+    }
+    
+    //
+    // @brief deleteElement sans branchement pour les cles entieres
+    //
+    // le fils est choisi par indice; le test d'egalite, faux jusqu'au
+    // dernier niveau, est bien predit. Les comptes sont decrementes en
+    // descendant, puis retablis en redescendant le chemin, deja en cache,
+    // si la cle est absente ou morte.
+    //
+    bool deleteIntegral(Node*& r, const_reference key) noexcept
+    {
+        Node** link = &r;
+        while (*link)
+        {
+            Stats::visit();
+            Stats::compare();
+            Node* n = *link;
+            if (n->key == key)
+            {
+                if (live(n))
+                {
+                    eraseOne(*link);
+                    return true;
+                }
+                break;
+            }
+            n->nbElements--;
+            link = &n->child[n->key < key];
+        }
+        for (Node* n = r; n != *link; n = n->child[n->key < key])
+        {
+            n->nbElements++;
+        }
+        return false;
+    }
+    
+    //
+    // @brief deleteElement des cles std::string, par prefixes
+    //
+    bool deleteString(Node*& r, const_reference key) noexcept
+    {
+        uint64_t prefix = packPrefix(key);
+        Node** link = &r;
+        while (*link)
+        {
+            Stats::visit();
+            Node* n = *link;
+            int c = order(key, prefix, n);
+            if (c == 0)
+            {
+                if (live(n))
+                {
+                    eraseOne(*link);
+                    return true;
+                }
+                break;
+            }
+            n->nbElements--;
+            link = c < 0 ? &n->left() : &n->right();
+        }
+        for (Node* n = r; n != *link; 
+             n = order(key, prefix, n) < 0 ? n->left() : n->right())
+        {
+            n->nbElements++;
+        }
+        return false;
+    }
+    
+    //
+    // @brief retire une occurrence de la cle du noeud r : diminue sa
+    //        multiplicite, ou retire le noeud s'il n'en reste qu'une
+    //
+    // les comptes des ancetres de r sont a la charge de l'appelant.
+    //
+    void eraseOne(Node*& r) noexcept
+    {
+        if constexpr (Multiset)
+        {
+            if (r->count > 1 or _lazy.enabled)
+            {
+                r->count--;
+                r->nbElements--;
+                if (!r->count) 
+                {
+                    // pierre tombale : le noeud reste en place
+                    _footprint.tombstones++;
+                    forget(r);
+                }
+                return;
+            }
+        }
+        else if (_lazy.enabled)
+        {
+            // pierre tombale : r ne se compte plus dans ses nbElements
+            r->nbElements--;
+            forget(r);
+            return;
+        }
+        removeNode(r);
+    }
+    
+    //
+    // @brief ajoute une occurrence a la cle du noeud n, qui revit s'il
+    //        etait mort
+    //
+    // les comptes des ancetres de n sont a la charge de l'appelant.
+    //
+    void addOccurrence(Node* n) noexcept
+    {
+        if constexpr (Multiset)
+        {
+            if (!n->count++) 
+            {
+                _footprint.tombstones--;
+            }
+        }
+        n->nbElements++;
+    }
+    
+    //
+    // @brief retire et libere le noeud r, remplace par son successeur
+    //        (suppression de Hibbard) s'il a deux fils
+    //
+    // les comptes des ancetres de r sont a la charge de l'appelant.
+    //
+    void removeNode(Node*& r) noexcept
+    {
+        if (!r->right())
+        {
+            Node *tmp = r;
+            r = r->left();
+            destroyNode(tmp);
+        } 
+        else if (!r->left()) 
+        {
+            Node *tmp = r;
+            r = r->right();
+            destroyNode(tmp);
+        } 
+        else // algo de suppression de Hibbard
+        {
+            Node *tmp = r;
+            size_t w = weight(tmp);
+            r = removeMinAndReturnIt(r->right());
+            r->nbElements = tmp->nbElements - w;
+            r->left() = tmp->left();
+            r->right() = tmp->right();
+            destroyNode(tmp);
+            Stats::restructure();
+            BST_TRACE(restructure, r);
+        }
+    }
+    
+public:
+  //
+  // @brief taille de l'arbre
+  //
+  // @return le nombre d'elements de l'arbre
+  // @remark Compexité en moyenne en O(1)
+  size_t size() const noexcept 
+  {
+      return size(_root);
+  }
+  
+  static size_t size(Node* r) noexcept 
+  { 
+      return r ? r->nbElements : 0;
+  }
+  
+  //
+  // @brief nombre d'occurrences de key, 0 si elle est absente
+  //
+  // au plus 1 hors multi-ensemble
+  // @remark Complexité en O(h)
+  size_t count(const_reference key) const noexcept 
+  {
+      typename Stats::Scope scope(TreeOp::Contains);
+      Node* r = _root;
+      while (r)
+      {
+          Stats::visit();
+          Stats::compare();
+          if (key < r->key)
+          {
+              r = r->left();
+          }
+          else if (Stats::compare(), r->key < key)
+          {
+              r = r->right();
+          }
+          else
+          {
+              return weight(r);
+          }
+      }
+      return 0;
+  }
+  
+private:
+  // occurrences de la cle du noeud n
+  //
+  // hors multi-ensemble, un noeud mort ne se compte pas dans ses
+  // nbElements : son poids se lit donc sur ceux de ses fils, et n doit
+  // etre dans un etat coherent (fils et comptes pas encore modifies).
+  static size_t weight(const Node* n) noexcept 
+  {
+      if constexpr (Multiset)
+      {
+          return n->count;
+      }
+      else
+      {
+          return n->nbElements - size(n->child[0]) - size(n->child[1]);
+      }
+  }
+  
+  // faux pour une pierre tombale de la suppression paresseuse
+  static bool live(const Node* n) noexcept 
+  {
+      return weight(n) != 0;
+  }
+  
+public:  
+  //
+  // @brief empreinte memoire de l'arbre
+  //
+  // les comptes sont tenus a jour a chaque allocation et liberation de
+  // noeud; la memoire possedee par les cles est evaluee par heap_usage.
+  // @remark Complexité O(1)
+  MemoryUsage memory_usage() const noexcept 
+  {
+      MemoryUsage m;
+      m.nodes = _footprint.nodes;
+      m.nodeBytes = m.nodes * sizeof(Node);
+      m.allocatorOverhead = _pool.bookkeepingBytes();
+      m.slack = (_pool.capacity() - m.nodes) * sizeof(Node);
+      m.keyHeapBytes = _footprint.keyHeap;
+      m.objectBytes = sizeof(*this);
+      m.hugePageAdvisedBytes = _pool.hugePageAdvisedBytes();
+      return m;
+  }
+  
+  //
+  // @brief statistiques des operations du thread courant
+  //
+  // @return les compteurs de la politique Stats, par operation. Vide avec
+  //         la politique par defaut NoStats.
+  // @remark Complexité O(1)
+  static stats_type stats() noexcept 
+  {
+      return Stats::snapshot();
+  }
+  
+  //
+  // @brief remet a zero les statistiques du thread courant
+  //
+  static void resetStats() noexcept 
+  {
+      Stats::reset();
+  }
+  //
+  // @brief cle en position n
+  //
+  // @return une reference a la cle en position n par ordre croissant des
+  // elements
+  //
+  // @exception std::logic_error si nécessaire
+  //
+  // ajoutez le code de gestion des exceptions, puis mettez en oeuvre
+  // la fonction recursive nth_element(Node*, n)
+  // @remark Compexité en O(n)
+  const_reference nth_element(size_t n) const 
+  {
+      typename Stats::Scope scope(TreeOp::NthElement);
+      if(n >= size(_root)) 
+      {
+          throw std::logic_error("logic_error_nth_element");
+      }
+      return nth_element(_root,n);
+  }
+  
+private:
+  //
+  // @brief cle en position n dans un sous arbre
+  //
+  // @param r la racine du sous arbre. ne peut pas etre nullptr
+  // @param n la position n, strictement inferieure a size(r)
+  //
+  // @return une reference a la cle en position n par ordre croissant des
+  // elements
+  // @remark Compexité en O(n)
+  static const_reference nth_element(Node* r, size_t n) noexcept 
+  {
+      Stats::visit();
+      size_t s = 0;
+      if (r->left()) 
+      {
+          s = r->left()->nbElements;
+      }
+      if (n < s) 
+      {
+          return nth_element(r->left(), n);
+      } 
+      else if (n >= s + weight(r)) 
+      {
+          return nth_element(r->right(), n - s - weight(r));
+      } 
+      else 
+      {
+          return r->key;
+      }
+  }
+  
+public:
+  //
+  // @brief quantile q des elements, au rang le plus proche
+  //
+  // la cle en position ceil(q * size()) - 1 (0 pour q = 0) : quantile(0.5)
+  // est la mediane basse, quantile(0.99) le p99.
+  //
+  // @exception std::domain_error si q n'est pas dans [0, 1]
+  // @exception std::logic_error si l'arbre est vide
+  // @remark Complexité en O(h)
+  const_reference quantile(double q) const 
+  {
+      typename Stats::Scope scope(TreeOp::Quantile);
+      return nth_element(_root, quantileIndex(q));
+  }
+  
+  //
+  // @brief plusieurs quantiles en une seule descente partagee
+  //
+  // les positions demandees sont triees puis cherchees ensemble : un noeud
+  // commun a plusieurs chemins n'est visite qu'une fois, et la descente se
+  // separe la ou les positions partent de cotes differents.
+  //
+  // @param qs les quantiles, dans [0, 1], dans un ordre quelconque. Tout
+  //           conteneur de double (vector, array, span...)
+  // @return les cles, dans l'ordre de qs
+  // @exception std::domain_error et std::logic_error comme quantile
+  // @remark Complexité en O(h * k) au pire pour k quantiles, bien moins
+  //         quand leurs chemins se partagent
+  template <typename Range>
+  vector<value_type> quantiles(const Range& qs) const 
+  {
+      typename Stats::Scope scope(TreeOp::Quantile);
+      // (position, indice dans qs), tries par position
+      vector<pair<size_t, size_t>> wanted;
+      for (double q : qs) 
+      {
+          wanted.emplace_back(quantileIndex(q), wanted.size());
+      }
+      sort(wanted.begin(), wanted.end());
+      vector<const value_type*> found(wanted.size());
+      nth_elements(wanted, found);
+      vector<value_type> keys;
+      keys.reserve(found.size());
+      for (const value_type* k : found) 
+      {
+          keys.push_back(*k);
+      }
+      return keys;
+  }
+  
+  vector<value_type> quantiles(initializer_list<double> qs) const 
+  {
+      return quantiles<initializer_list<double>>(qs);
+  }
+  
+private:
+  size_t quantileIndex(double q) const 
+  {
+      if (!(q >= 0 and q <= 1)) 
+      {
+          throw std::domain_error("domain_error_quantile");
+      }
+      if (!size()) 
+      {
+          throw std::logic_error("logic_error_quantile");
+      }
+      size_t n = size();
+      size_t i = size_t(ceil(q * double(n)));
+      return std::min(n, std::max<size_t>(i, 1)) - 1;
+  }
+  
+  //
+  // @brief cles des positions wanted, triees, dans found
+  //
+  // chaque element de la pile est un sous-arbre, la position de son
+  // premier element et la tranche de wanted qui y tombe. Iteratif : un
+  // arbre degenere ne deborde pas la pile.
+  //
+  void nth_elements(const vector<pair<size_t, size_t>>& wanted, 
+                    vector<const value_type*>& found) const 
+  {
+      struct Step
+      {
+          Node* r;
+          size_t offset;
+          size_t lo, hi;
+      };
+      vector<Step> stack;
+      if (!wanted.empty()) 
+      {
+          stack.push_back({ _root, 0, 0, wanted.size() });
+      }
+      while (!stack.empty()) 
+      {
+          Step st = stack.back();
+          stack.pop_back();
+          Stats::visit();
+          size_t left = st.offset + size(st.r->left());
+          size_t right = left + weight(st.r);
+          size_t i = st.lo;
+          while (i < st.hi and wanted[i].first < left) 
+          {
+              ++i;
+          }
+          size_t j = i;
+          while (j < st.hi and wanted[j].first < right) 
+          {
+              found[wanted[j].second] = &st.r->key;
+              ++j;
+          }
+          if (st.lo < i) 
+          {
+              stack.push_back({ st.r->left(), st.offset, st.lo, i });
+          }
+          if (j < st.hi) 
+          {
+              stack.push_back({ st.r->right(), right, j, st.hi });
+          }
+      }
+  }
+  
+public:
+  //
+  // @brief position d'une cle dans l'ordre croissant des elements de l'arbre
+  //
+  // @param key la cle dont on cherche le rang
+  //
+  // @return la position entre 0 et size()-1, size_t(-1) si la cle est absente
+  //
+  // Ne pas modifier mais écrire la fonction
+  // récursive privée rank(Node*,const_reference)
+  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
+  size_t rank(const_reference key) const noexcept 
+  {
+        typename Stats::Scope scope(TreeOp::Rank);
+        return rank(_root, key);
+  }
+  
+private:
+  //
+    // @brief position d'une cle dans l'ordre croissant des elements du sous-arbre
+    //
+    // @param key la cle dont on cherche le rang
+    // @param r la racine du sous arbre
+    //
+    // @return la position entre 0 et size()-1, size_t(-1) si la cle est absente
+    // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
+    static size_t rank(Node* r, const_reference key) noexcept 
+    {
+        if constexpr (integralKeys)
+        {
+            // pos compte les cles inferieures ou egales a key rencontrees :
+            // si le dernier noeud ou l'on est parti a droite est key, son
+            // rang est pos - 1. Le compte du fils gauche est lu a chaque
+            // niveau; quand on va a gauche, c'est le prochain noeud visite.
+            size_t pos = 0;
+            Node* candidate = nullptr;
+            while (r)
+            {
+                Stats::visit();
+                Stats::compare();
+                bool right = r->key <= key;
+                size_t before = size(r->left()) + weight(r);
+                pos += before & -size_t(right);
+                candidate = right ? r : candidate;
+                r = r->child[right];
+            }
+            return candidate and candidate->key == key and live(candidate)
+                   ? pos - weight(candidate) : size_t(-1);
+        }
+        else if constexpr (stringKeys)
+        {
+            uint64_t prefix = packPrefix(key);
+            size_t pos = 0;
+            while (r)
+            {
+                Stats::visit();
+                int c = order(key, prefix, r);
+                size_t before = size(r->left());
+                if (c < 0)
                 {
-                    return false;
+                    r = r->left();
                 }
-            } 
-            else if (key > r->key) // key recherchée supérieure au noeud actuel, on
-            { // va vers la droite
-                if (deleteElement(r->right, key)) // si on a trouvé la clé
+                else if (c > 0)
                 {
-                    r->nbElements--;
-                    return true;
-                } 
-                else 
+                    pos += before + weight(r);
+                    r = r->right();
+                }
+                else
                 {
-                    return false;
+                    return live(r) ? pos + before : size_t(-1);
                 }
-            } 
-            else 
-            { 
-                if (!r->right) // on a la key
+            }
+            return size_t(-1);
+        }
+        else
+        {
+            size_t nbElementCmp;
+            if (r) 
+            {
+                size_t s = 0;
+                Stats::visit();
+                Stats::compare();
+                if (key < r->key) 
                 {
-                    delete r;
-                    r = r->left;
-                } 
-                else if (!r->left) 
+                    s = rank(r->left(), key);
+                    if (s != size_t(-1)) 
+                    {
+                        return s;
+                    }
+                }
+                else if (Stats::compare(), key > r->key) 
                 {
-                    delete r;
-                    r = r->right;
-                } 
-                else // algo de suppression de Hibbard
+                    s = rank(r->right(), key);
+                    if (s != size_t(-1)) 
+                    {
+                        if (!r->left()) 
+                        {
+                            nbElementCmp = 0;
+                        }
+                        else 
+                        {
+                            nbElementCmp = r->left()->nbElements;
+                        }
+                        return s + nbElementCmp + weight(r);
+                    }
+                }
+                else 
                 {
-                    Node *tmp = r;
-                    r = removeMinAndReturnIt(r->right);
-                    r->nbElements = tmp->nbElements - 1;
-                    r->left = tmp->left;
-                    r->right = tmp->right;
-                    delete tmp;
+                    if (!r->left()) 
+                    {
+                        nbElementCmp = 0;
+                    }
+                    else 
+                    {
+                        nbElementCmp = r->left()->nbElements;
+                    }
+                    return live(r) ? nbElementCmp : size_t(-1);
                 }
-                return true;
+            } 
+            else 
+            {
+                return size_t(-1);
             }
+            return size_t(-1);
+        }
+    }
+    
+public:
+  //
+  // @brief linearise l'arbre
+  //
+  // transforme l'arbre en une liste simplement chainee composee des memes
+  // noeuds que precedemment, mais dont les pointeurs left sont tous egaux
+  // a nullptr. Cette liste doit toujours respecter les conditions d'un
+  // arbre binaire de recherche
+  //
+  // Ne pas modifier cette fonction qui sert essentiellement a tester la
+  // fonction recursive linearize(Node*, Node*&, size_t&) utilisée par
+  // la methode publique arborize
+  // @remark Complexité en O(n)
+  void linearize() noexcept 
+  {
+    typename Stats::Scope scope(TreeOp::Linearize);
+    size_t cnt = 0;
+    Node* list = nullptr;
+    _epoch++;
+    BST_TRACE(linearize_begin, size());
+    linearize(_root,list,cnt);
+    BST_TRACE(linearize_end, cnt);
+    _root = list;
+  }
+  
+private:
+  //
+  // @brief linearise une sous arbre tree en une liste
+  //
+  // @param tree pointe vers la racine de l'arbre a lineariser
+  // @param list reference a la tete de la liste a creer. sera modifiee
+  //             par la fonction pour que list pointe vers le plus petit
+  //             element de tree
+  // @param cnt  calcule au fure et a mesure le nombre d'elements de la liste
+  //             cree. l'effet de la fonction doit etre d'ajouter le nombre
+  //             d'elements du sous-arbre de racine tree. Cependant, vous
+  //             avez uniquement le droit d'utiliser l'opérateur ++.
+  // @remark Compexité en O(n)
+  static void linearize(Node* tree, Node*& list, size_t& cnt) noexcept 
+  {
+      // Parcours symétrique inverse pour les mettre dans une liste
+      // sans oublier de mettre l'élément de gauche à nul sous peine
+      // de créer une boucle infinie
+      if(tree)
+      {
+          Stats::visit();
+          size_t w = weight(tree); // avant que ses fils ne changent
+          linearize(tree->right(), list, cnt); // on va à l'élément plus à droite
+          tree->right() = list; // sauve la liste dans l'élément suivant
+          list = tree; // affecte l'arbre courant à la liste
+          cnt++; 
+          list->nbElements = size(list->right()) + w;
+          linearize(tree->left(), list, cnt);
+          tree->left() = nullptr; // on détache à gauche
+      }
+  }
+  
+  
+public:
+  //
+  // @brief equilibre l'arbre
+  //
+  // applique l'algorithme d'equilibrage de l'arbre par linearisation et
+  // arborisation
+  //
+  // Ne pas modifier cette fonction.
+  // @remark Complexité O(n)
+  void balance() noexcept 
+  {
+    typename Stats::Scope scope(TreeOp::Balance);
+    size_t cnt = 0;
+    Node* list = nullptr;
+    size_t dead = tombstones();
+    _epoch++;
+    BST_TRACE(rebalance_begin, size());
+    BST_TRACE(linearize_begin, size());
+    linearize(_root,list,cnt);
+    BST_TRACE(linearize_end, cnt);
+    cnt -= dropTombstones(list, dead);
+    BST_TRACE(arborize_begin, cnt);
+    arborize(_root,list,cnt);
+    BST_TRACE(arborize_end, cnt);
+    BST_TRACE(rebalance_end, cnt);
+    _watch.clear();
+  }
+  
+  //
+  // @brief suppression paresseuse
+  //
+  // active, deleteElement ne retire plus le noeud de sa derniere
+  // occurrence : il reste en place (pierre tombale), de multiplicite nulle
+  // ou, hors multi-ensemble, sans se compter dans ses nbElements, et ses
+  // ancetres perdent un element, si bien que size, rank,
+  // nth_element et les quantiles restent exacts. Une insertion de la meme
+  // cle le fait revivre sans allocation. Des que les noeuds morts depassent
+  // maxDeadRatio des noeuds, balance les retire tous, entre linearisation
+  // et arborisation ; compact et balance le font aussi a la demande.
+  //
+  // @param enabled vrai pour supprimer paresseusement
+  // @param maxDeadRatio part de noeuds morts toleree
+  // @remark Complexité O(1), les pierres tombales deja posees restent
+  void setLazyDeletion(bool enabled, double maxDeadRatio = 0.25) noexcept 
+  {
+      _lazy.enabled = enabled;
+      _lazy.maxDeadRatio = maxDeadRatio;
+  }
+  
+  bool lazyDeletion() const noexcept 
+  {
+      return _lazy.enabled;
+  }
+  
+  //
+  // @brief nombre de noeuds morts en attente de balance
+  //
+  size_t tombstones() const noexcept 
+  {
+      if constexpr (Multiset)
+      {
+          return _footprint.tombstones;
+      }
+      else
+      {
+          // chaque noeud vivant compte pour un element
+          return _footprint.nodes - size();
+      }
+  }
+  
+private:
+  //
+  // @brief balance si les noeuds morts depassent le seuil
+  //
+  void purgeIfNeeded() noexcept 
+  {
+      size_t dead = tombstones();
+      if (dead and double(dead) > _lazy.maxDeadRatio * double(_footprint.nodes)) 
+      {
+          balance();
+      }
+  }
+  
+  //
+  // @brief retire et libere les noeuds morts d'une liste linearisee
+  //
+  // les nbElements de la liste, des tailles de suffixes, ne changent pas :
+  // un noeud mort n'y compte pour rien.
+  //
+  // @param dead nombre de noeuds morts de la liste, compte avant la
+  //             linearisation
+  // @return le nombre de noeuds retires
+  // @remark Complexité O(n)
+  size_t dropTombstones(Node*& list, size_t dead) noexcept 
+  {
+      size_t dropped = 0;
+      for (Node** link = &list; dropped < dead and *link; ) 
+      {
+          Node* n = *link;
+          if (live(n)) 
+          {
+              link = &n->right();
+          } 
+          else 
+          {
+              *link = n->right();
+              destroyNode(n);
+              dropped++;
+          }
+      }
+      return dropped;
+  }
+  
+public:
+  
+  //
+  // @brief politique de re-equilibrage automatique
+  //
+  // remet a zero les observations en cours
+  // @remark Complexité O(1)
+  void setRebalancePolicy(const RebalancePolicy& policy) noexcept 
+  {
+      _watch = DepthWatch();
+      _watch.policy = policy;
+  }
+  
+  const RebalancePolicy& rebalancePolicy() const noexcept 
+  {
+      return _watch.policy;
+  }
+  
+  //
+  // @brief vrai si un re-equilibrage a ete declenche mais pas encore execute
+  //
+  bool rebalancePending() const noexcept 
+  {
+      return _watch.pending.load(memory_order_relaxed);
+  }
+  
+  //
+  // @brief execute le re-equilibrage en attente, notamment en mode Deferred
+  //
+  // @return vrai si l'arbre a ete equilibre
+  // @remark Complexité O(n) si un re-equilibrage est en attente, O(1) sinon
+  bool maintain() noexcept 
+  {
+      if (!_watch.pending.load(memory_order_relaxed)) 
+      {
+          return false;
+      }
+      balance();
+      return true;
+  }
+  
+private:
+  //
+  // @brief vrai si depth niveaux depassent depthFactor * log2(size())
+  //
+  bool tooDeep(size_t depth) const noexcept 
+  {
+      // la hauteur depend du nombre de noeuds, pas des multiplicites
+      return depth > _watch.policy.depthFactor 
+                     * ShapeReport::optimalHeight(_footprint.nodes);
+  }
+  
+  //
+  // @brief enregistre une observation et marque le re-equilibrage en
+  //        attente si la fenetre compte trop de violations
+  //
+  // sure pour des lecteurs concurrents, voir DepthWatch
+  //
+  void observe(bool deep) const noexcept 
+  {
+      if (deep and _watch.violations.fetch_add(1, memory_order_relaxed) 
+                       >= _watch.policy.maxViolations) 
+      {
+          _watch.pending.store(true, memory_order_relaxed);
+      }
+      if (_watch.observed.fetch_add(1, memory_order_relaxed) + 1 
+              >= _watch.policy.window) 
+      {
+          _watch.observed.store(0, memory_order_relaxed);
+          _watch.violations.store(0, memory_order_relaxed);
+      }
+  }
+  
+  void rebalanceIfPending() noexcept 
+  {
+      if (_watch.policy.mode != RebalanceMode::Deferred) 
+      {
+          maintain();
+      }
+  }
+  
+  //
+  // @brief reconstruit le bouc emissaire d'une insertion trop profonde
+  //
+  // remonte le chemin de key jusqu'au premier ancetre dont un sous-arbre
+  // contient plus de alpha = 2^(-1/depthFactor) de ses elements, puis
+  // equilibre ce seul sous-arbre. Une profondeur superieure a
+  // depthFactor * log2(n) garantit l'existence d'un tel ancetre.
+  // @remark Complexité O(h + taille du sous-arbre reconstruit), O(log(n))
+  //         amorti
+  void rebuildScapegoat(const_reference key) 
+  {
+      _epoch++;
+      double alpha = pow(2.0, -1.0 / _watch.policy.depthFactor);
+      vector<Node**> path;
+      for (Node** link = &_root; *link and ((*link)->key < key or key < (*link)->key); ) 
+      {
+          path.push_back(link);
+          link = key < (*link)->key ? &(*link)->left() : &(*link)->right();
+      }
+      for (size_t i = path.size(); i-- > 0; ) 
+      {
+          Node* r = *path[i];
+          if (std::max(size(r->left()), size(r->right())) > alpha * r->nbElements) 
+          {
+              size_t cnt = 0;
+              Node* list = nullptr;
+              BST_TRACE(rebalance_begin, r->nbElements);
+              linearize(*path[i], list, cnt);
+              arborize(*path[i], list, cnt);
+              BST_TRACE(rebalance_end, cnt);
+              return;
+          }
+      }
+  }
+  
+  //
+  // @brief arborise les cnt premiers elements d'une liste en un arbre
+  //
+  // @param tree reference dans laquelle il faut ecrire la racine de l'arbre
+  //             arborise par la fonction
+  // @param list IN - reference a la tete de la liste a parcourir. La liste
+  //                  est composee de Node dont le pointer left est nullptr
+  //             OUT - debut de la suite de la liste dont on a utilise cnt
+  //                   elements
+  // @param cnt  nombre d'elements de la liste que l'on doit utiliser pour
+  //             arboriser le sous arbre
+  // @remark Complexité O(n)
+    static void arborize(Node *& tree, Node *& list, size_t cnt) noexcept 
+    {
+        Node *subTreeR;
+        Node *subTreeL; 
+        if (cnt > 0)
+        {
+            size_t cntL = (cnt - 1) / 2; // pour compteur pour le s-a gauche
+            size_t cntR = cnt - cntL - 1; // pour compteur pour le s-a droite
+            arborize(subTreeL, list, cntL); 
+            tree = list; 
+            size_t w = weight(tree); // lu sur la liste, avant arborisation
+            list = list->right();
+            Stats::restructure();
+            arborize(subTreeR, list, cntR); 
+            tree->nbElements = size(subTreeL) + size(subTreeR) + w;
+            tree->right() = subTreeR;
+            tree->left() = subTreeL; 
         } 
         else 
-        { 
-            return false;
+        {
+            tree = nullptr;
         }
     }
-    
-public:
+  
+public:
+  //
+  // @brief forme exacte de l'arbre
+  //
+  // hauteur, profondeur moyenne, histogramme des profondeurs et desequilibre
+  // le plus fort, en un seul parcours iteratif (sans recursion, l'arbre
+  // pouvant etre degenere).
+  //
+  // @remark Complexité O(n)
+  ShapeReport shape_report() const
+  {
+      ShapeReport report;
+      report.size = _footprint.nodes;
+      vector<pair<Node*, size_t>> stack;
+      if (_root) 
+      {
+          stack.emplace_back(_root, 0);
+      }
+      while (!stack.empty()) 
+      {
+          Node* r = stack.back().first;
+          size_t depth = stack.back().second;
+          stack.pop_back();
+          report.addDepth(depth);
+          report.addNode(size(r->left()), size(r->right()));
+          if (r->left()) 
+          {
+              stack.emplace_back(r->left(), depth + 1);
+          }
+          if (r->right()) 
+          {
+              stack.emplace_back(r->right(), depth + 1);
+          }
+      }
+      report.finish();
+      return report;
+  }
+  
+  //
+  // @brief forme de l'arbre estimee par echantillonnage
+  //
+  // chaque echantillon descend vers une occurrence tiree uniformement grace
+  // aux nbElements : a chaque noeud r on s'arrete avec probabilite
+  // weight(r)/r->nbElements, sinon on descend proportionnellement a la
+  // taille des sous-arbres. Un noeud est donc atteint en proportion de ses
+  // occurrences : chaque echantillon compte pour 1/weight(r) noeud, et les
+  // pierres tombales, sans occurrence, ne sont jamais atteintes.
+  //
+  // @param samples nombre de descentes
+  // @param seed graine du tirage
+  // @remark Complexité O(samples * h)
+  ShapeReport shape_report(size_t samples, unsigned long seed = 0) const
+  {
+      ShapeReport report;
+      report.size = _footprint.nodes;
+      report.sampled = true;
+      report.samples = samples;
+      if (!size()) 
+      {
+          report.finish();
+          return report;
+      }
+      mt19937_64 rng(seed);
+      for (size_t i = 0; i < samples; ++i) 
+      {
+          Node* r = _root;
+          size_t depth = 0;
+          while (true) 
+          {
+              size_t s = size(r->left());
+              report.addNode(s, size(r->right()));
+              size_t pick = rng() % r->nbElements;
+              if (pick >= s and pick < s + weight(r)) 
+              {
+                  break;
+              }
+              r = pick < s ? r->left() : r->right();
+              depth++;
+          }
+          report.addDepth(depth, 1.0 / weight(r));
+      }
+      report.finish();
+      return report;
+  }
+  
+  //
+  // @brief equilibre l'arbre si sa hauteur s'est trop eloignee de l'optimum
+  //
+  // @param maxHeightRatio rapport heightRatio au dela duquel on equilibre
+  // @param samples nombre de descentes de l'estimation, 0 pour un calcul
+  //                exact en O(n)
+  //
+  // @return vrai si l'arbre a ete equilibre
+  // @remark Complexité O(samples * h), plus O(n) si l'arbre est equilibre
+  bool balanceIfNeeded(double maxHeightRatio = 2, size_t samples = 64)
+  {
+      ShapeReport report = samples ? shape_report(samples) : shape_report();
+      if (report.heightRatio <= maxHeightRatio) 
+      {
+          return false;
+      }
+      balance();
+      return true;
+  }
+  
+  //
+  // @brief equilibre l'arbre et regroupe ses noeuds dans un seul bloc
+  //
+  // comme balance, linearise puis arborise l'arbre, mais recopie au passage
+  // chaque noeud dans un bloc neuf d'un emplacement par noeud, dans
+  // l'ordre order. Les anciens blocs sont ensuite rendus d'un coup. Les cles
+  // sont copiees : si une copie leve une exception, l'arbre reste equilibre
+  // dans ses anciens noeuds.
+  //
+  // @param order ordre des noeuds dans le nouveau bloc
+  // @remark Complexité O(n)
+  void compact(CompactOrder order = CompactOrder::InOrder)
+  {
+      // balance retire d'abord les pierres tombales. Un noeud par cle :
+      // size() compterait les occurrences d'un multi-ensemble
+      balance();
+      size_t n = _footprint.nodes;
+      Pool fresh;
+      fresh.setBacking(_pool.backing());
+      if (n) 
+      {
+          fresh.reserve(n);
+      }
+      BST_TRACE(relocate_begin, n);
+      Node* tree = nullptr;
+      size_t keyHeap = 0;
+      try 
+      {
+          relocate(tree, fresh, order, keyHeap);
+      }
+      catch (...) 
+      {
+          // les noeuds deja recopies sont detruits avec fresh
+          destroyCopies(tree);
+          throw;
+      }
+      destroyAll(_root);
+      _root = tree;
+      _ends = Ends();
+      _epoch++;
+      _pool.swap(fresh);
+      _footprint.keyHeap = keyHeap;
+      settleEnds();
+      BST_TRACE(relocate_end, n);
+  }
+  
+  //
+  // @brief copie figee et triee des cles, placee sur le noeud NUMA node
+  //
+  // le parcours symetrique est iteratif : un arbre degenere ne deborde pas
+  // la pile.
+  //
+  // @param node noeud NUMA des cles copiees, -1 pour ne pas en choisir
+  // @remark Complexité O(n)
+  FrozenSnapshot<T> freeze(int node = -1) const
+  {
+      typename FrozenSnapshot<T>::Storage keys{ NodeLocalAllocator<T>(node) };
+      keys.reserve(size());
+      vector<Node*> path;
+      Node* r = _root;
+      while (r or !path.empty()) 
+      {
+          while (r) 
+          {
+              path.push_back(r);
+              r = r->left();
+          }
+          r = path.back();
+          path.pop_back();
+          keys.insert(keys.end(), weight(r), r->key);
+          r = r->right();
+      }
+      return FrozenSnapshot<T>(std::move(keys));
+  }
+  
+  //
+  // @brief pages memoire des noeuds alloues desormais
+  //
+  // les noeuds deja en place y restent : compact() les recopie dans des
+  // blocs du nouveau mode. Sans pages de 2 Mo disponibles, les blocs
+  // retombent sur des pages ordinaires (voir PageBacking).
+  //
+  // @remark Complexité O(1)
+  void setPageBacking(PageBacking backing) noexcept 
+  {
+      _pool.setBacking(backing);
+  }
+  
+  PageBacking pageBacking() const noexcept 
+  {
+      return _pool.backing();
+  }
+  
+private:
+  //
+  // @brief recopie l'arbre equilibre _root dans fresh
+  //
+  // @param tree recoit la racine de la copie, valide meme si une copie de
+  //             cle echoue en cours de route
+  //
+  void relocate(Node*& tree, Pool& fresh, CompactOrder order, size_t& keyHeap)
+  {
+      // file des noeuds a recopier, avec le lien de la copie a remplir
+      vector<pair<Node*, Node**>> queue;
+      queue.reserve(_footprint.nodes);
+      if (_root) 
+      {
+          queue.emplace_back(_root, &tree);
+      }
+      if (order == CompactOrder::BreadthFirst) 
+      {
+          for (size_t i = 0; i < queue.size(); ++i) 
+          {
+              Node* copy = relocateNode(queue[i].first, *queue[i].second, 
+                                        fresh, keyHeap);
+              if (queue[i].first->left()) 
+              {
+                  queue.emplace_back(queue[i].first->left(), &copy->left());
+              }
+              if (queue[i].first->right()) 
+              {
+                  queue.emplace_back(queue[i].first->right(), &copy->right());
+              }
+          }
+      }
+      else 
+      {
+          relocateInOrder(_root, tree, fresh, keyHeap);
+      }
+  }
+  
+  void relocateInOrder(Node* r, Node*& link, Pool& fresh, size_t& keyHeap)
+  {
+      if (r) 
+      {
+          // l'emplacement du sous-arbre gauche precede celui du noeud : on
+          // recopie d'abord la gauche dans un lien temporaire
+          Node* left = nullptr;
+          try 
+          {
+              relocateInOrder(r->left(), left, fresh, keyHeap);
+          }
+          catch (...) 
+          {
+              destroyCopies(left);
+              throw;
+          }
+          Node* copy;
+          try 
+          {
+              copy = relocateNode(r, link, fresh, keyHeap);
+          }
+          catch (...) 
+          {
+              destroyCopies(left);
+              throw;
+          }
+          copy->left() = left;
+          relocateInOrder(r->right(), copy->right(), fresh, keyHeap);
+      }
+  }
+  
+  // recopie un seul noeud et l'accroche a link
+  static Node* relocateNode(Node* r, Node*& link, Pool& fresh, size_t& keyHeap)
+  {
+      Node* copy = new (fresh.allocate()) Node(r->key);
+      Stats::allocate();
+      BST_TRACE(node_alloc, copy);
+      copy->nbElements = r->nbElements;
+      if constexpr (Multiset)
+      {
+          copy->count = r->count;
+      }
+      keyHeap += heap_usage(copy->key);
+      link = copy;
+      return copy;
+  }
+  
+  // detruit les cles d'une copie partielle, sa memoire partant avec sa reserve
+  static void destroyCopies(Node* r) noexcept
+  {
+      destroyAll(r);
+  }
+  
+  // detruit les anciens noeuds sans les rendre a _pool, qui va etre liberee.
+  // Chacun compte comme une liberation, sa copie comme une allocation
+  static void destroyAll(Node* r) noexcept
+  {
+      if (r) 
+      {
+          destroyAll(r->left());
+          destroyAll(r->right());
+          BST_TRACE(node_free, r);
+          r->~Node();
+          Stats::release();
+      }
+  }
+  
+public:
+  //
+  // @brief Parcours pre-ordonne de l'arbre
+  //
+  // @param f une fonction capable d'être appelée en recevant une cle
+  //          en parametre. Pour le noeud n courrant, l'appel sera
+  //          f(n->key);
+  // @remark Compexité en moyenne en O(n)
+  template <typename Fn>
+  void visitPre (Fn f) 
+  {
+      if(_root != nullptr)
+      {
+          parcoursPreOrdonne(_root, f);
+      }
+  }
+  
+  template<typename Fn>
+  void parcoursPreOrdonne(Node *leaf, Fn f)
+  {
+      for (size_t i = 0; i < weight(leaf); ++i) // chaque occurrence
+      {
+          f(leaf->key);
+      }
+
+      if(leaf->left() != nullptr)
+      {
+          parcoursPreOrdonne(leaf->left(), f);
+      }
+      
+      if(leaf->right() != nullptr)
+      {
+          parcoursPreOrdonne(leaf->right(), f);
+      }
+  }
+  
+  //
+  // @brief Parcours symétrique de l'arbre
+  //
+  // @param f une fonction capable d'être appelée en recevant une cle
+  //          en parametre. Pour le noeud n courrant, l'appel sera
+  //          f(n->key);
+  // @remark Compexité en moyenne en O(n)
+  template <typename Fn>
+  void visitSym (Fn f) 
+  {
+      if(_root != nullptr)
+      {
+          parcoursSymetrique(_root, f);
+      }
+  }
+  
+  template <typename Fn>
+  void parcoursSymetrique(Node *leaf, Fn f)
+  {
+      if(leaf->left() != nullptr)
+      {
+          parcoursSymetrique(leaf->left(), f);
+      }
+
+      for (size_t i = 0; i < weight(leaf); ++i) // chaque occurrence
+      {
+          f(leaf->key);
+      }
+      
+      if(leaf->right() != nullptr)
+      {
+          parcoursSymetrique(leaf->right(), f);
+      }
+  }
+  
+  //
+  // @brief Parcours post-ordonne de l'arbre
+  //
+  // @param f une fonction capable d'être appelée en recevant une cle
+  //          en parametre. Pour le noeud n courrant, l'appel sera
+  //          f(n->key);
+  // @remark Compexité en moyenne en O(n)
+  template < typename Fn >
+  void visitPost (Fn f) 
+  {
+      if(_root != nullptr)
+      {
+          parcoursPostOrdonne(_root, f);
+      }
+  }
+  
+  template<typename Fn>
+  void parcoursPostOrdonne(Node *leaf, Fn f)
+  {
+      if(leaf->left() != nullptr)
+      {
+          parcoursPostOrdonne(leaf->left(), f);
+      }
+      
+      if(leaf->right() != nullptr)
+      {
+          parcoursPostOrdonne(leaf->right(), f);
+      }
+ 
+      for (size_t i = 0; i < weight(leaf); ++i) // chaque occurrence
+      {
+          f(leaf->key);
+      }
+  }
+  
+  
+  //
+  // Les fonctions suivantes sont fournies pour permettre de tester votre classe
+  // Merci de ne rien modifier au dela de cette ligne
+  //
+  void display() const 
+  {
+    stringstream ss1, ss2, ss3;
+    displayKeys(ss1);
+    displayKeys(ss3);
+    displayCounts(ss2);
+    string l1, l2;
+    
+    size_t W = 11;
+    while( getline(ss3,l1))
+      if (l1.length() > W) W = l1.length();
+
+    displayKeys(ss1);
+    
+    cout << "\n";
+    cout << "+-" << left << setfill('-') << setw(W) << "-" << "+-" << setw(W) << "-" << setfill(' ') << "+" << endl;
+    cout << "| "<< left << setw(W) << "key" << "| " << setw(W) << "nbElements" << "|" << endl;
+    cout << "+-" << left << setfill('-') << setw(W) << "-" << "+-" << setw(W) << "-" << setfill(' ') << "+" << endl;
+    while( getline(ss1,l1) and getline(ss2, l2) ) {
+      cout << "| "<< left << setw(W) << l1 << "| " << setw(W) << l2 << "|" << endl;
+    }
+    cout << "+-" << left << setfill('-') << setw(W) << "-" << "+-" << setw(W) << "-" << setfill(' ') << "+" << endl;
+  }
+  
+  void displayKeys(ostream& os = cout) const 
+  {
+    display([](Node* n) -> const_reference { return n->key; }, os);
+  }
+  
+  void displayCounts(ostream& os = cout) const 
+  {
+    display([](Node* n) -> size_t { return n->nbElements; }, os);
+  }
+  
+  //
+  // utilise un parcours de l'arbre en largeur avec
+  // un noeud sentinelle newLevel qui traque les
+  // changements de niveaux
+  //
+  template <typename Fn>
+  void display (Fn func, ostream& os = cout ) const 
+  {
+    Node* newLevel = (Node*) -1;
+    // addresse non nulle dont on est sur qu'elle ne contient pas
+    // vraiment un Node. Utilisée comme sentinelle.
+    
+    queue<Node*> Q;
+    Q.push(_root);
+    Q.push(newLevel);
+    
+    while(!Q.empty()) {
+      Node* cur = Q.front();
+      Q.pop();
+      
+      if(cur == newLevel) {
+        os << endl;
+        if(!Q.empty())
+          Q.push(newLevel);
+      } else if(cur == nullptr) {
+        os << "- ";
+      } else {
+        os << func(cur) << " ";
+        Q.push(cur->left());
+        Q.push(cur->right());
+      }
+    }
+  }
+};
+
+//
+// @brief Copies figees d'un arbre, une par noeud NUMA, pour ses lecteurs
+//
+// L'ecrivain modifie l'arbre primaire (non synchronise, comme tout
+// BinarySearchTree) et appelle refresh depuis son propre thread, par exemple
+// apres chaque lot de mises a jour ou via refresh(primary, period). Chaque
+// copie est reconstruite sur son noeud puis publiee atomiquement. Les
+// lecteurs de tous les threads interrogent la copie de leur noeud sans
+// toucher a l'arbre primaire; une copie publiee n'est plus modifiee et vit
+// tant qu'un lecteur la tient.
+//
+// Prendre une copie passe par atomic_load de shared_ptr : un lecteur qui
+// enchaine les requetes garde local() le temps d'un lot plutot que de la
+// reprendre a chaque requete.
+//
+template <typename T>
+class NumaReplicas
+{
+public:
+  using value_type = T;
+  using const_reference = const T&;
+  using Snapshot = FrozenSnapshot<T>;
+  using Handle = shared_ptr<const Snapshot>;
+
+private:
+  vector<Handle> _replicas;
+  atomic<uint64_t> _version{ 0 };
+  chrono::steady_clock::time_point _refreshed;
+
+public:
+  //
+  // @param replicas nombre de copies, une par noeud NUMA par defaut. Les
+  //        copies au-dela du nombre de noeuds n'ont pas de noeud prefere :
+  //        le routage s'exerce ainsi sur une machine a un seul noeud.
+  explicit NumaReplicas(size_t replicas = NumaTopology::nodes()) 
+  : _replicas(std::max<size_t>(1, replicas), make_shared<const Snapshot>())
+  { }
+
+  //
+  // @brief reconstruit et publie toutes les copies depuis primary
+  //
+  // a appeler depuis le thread qui modifie primary.
+  // @remark Complexité O(n) par copie
+  template <typename Stats, bool Multiset>
+  void refresh(const BinarySearchTree<T, Stats, Multiset>& primary)
+  {
+    vector<Handle> fresh;
+    fresh.reserve(_replicas.size());
+    fresh.push_back(make_shared<const Snapshot>(primary.freeze(preferred(0))));
+    for (size_t i = 1; i < _replicas.size(); ++i) 
+    {
+      fresh.push_back(make_shared<const Snapshot>(*fresh[0], preferred(i)));
+    }
+    for (size_t i = 0; i < _replicas.size(); ++i) 
+    {
+      atomic_store(&_replicas[i], std::move(fresh[i]));
+    }
+    _version.fetch_add(1, memory_order_release);
+    _refreshed = chrono::steady_clock::now();
+  }
+
+  //
+  // @brief comme refresh(primary), si la derniere date d'au moins period
+  //
+  // @return vrai si les copies ont ete reconstruites
+  template <typename Stats, bool Multiset, typename Rep, typename Period>
+  bool refresh(const BinarySearchTree<T, Stats, Multiset>& primary, 
+               chrono::duration<Rep, Period> period)
+  {
+    if (_version.load(memory_order_relaxed) and 
+        chrono::steady_clock::now() - _refreshed < period) 
+    {
+      return false;
+    }
+    refresh(primary);
+    return true;
+  }
+
+  //
+  // @brief copie du noeud NUMA qui execute le thread appelant
+  //
+  Handle local() const 
+  { 
+    return replica(size_t(NumaTopology::currentNode())); 
+  }
+
+  Handle replica(size_t i) const 
+  { 
+    return atomic_load(&_replicas[i % _replicas.size()]); 
+  }
+
+  bool contains(const_reference key) const 
+  { 
+    return local()->contains(key); 
+  }
+
+  size_t rank(const_reference key) const 
+  { 
+    return local()->rank(key); 
+  }
+
+  //
+  // @return une copie de la cle : la copie figee peut etre remplacee des
+  //         le retour
+  value_type nth_element(size_t n) const 
+  { 
+    return local()->nth_element(n); 
+  }
+
+  size_t size() const 
+  { 
+    return local()->size(); 
+  }
+
+  size_t replicas() const noexcept 
+  { 
+    return _replicas.size(); 
+  }
+
+  //
+  // @brief nombre de refresh publies
+  //
+  uint64_t version() const noexcept 
+  { 
+    return _version.load(memory_order_acquire); 
+  }
+
+private:
+  static int preferred(size_t i) noexcept 
+  {
+    return int(i) < NumaTopology::nodes() ? int(i) : -1;
+  }
+};
+
+//
+// @brief statistiques d'ordre sur les dernieres cles recues
+//
+// fenetre glissante en nombre (les capacity dernieres cles) et, en option,
+// en duree (les cles de moins de horizon). Les cles vivent dans un arbre
+// multiensemble ; un tampon circulaire garde l'ordre d'arrivee et donne la
+// cle la plus ancienne, que l'eviction retire ensuite de l'arbre par une
+// recherche en O(h). Chaque arrivee coute une insertion et au plus une
+// suppression, en O(h) : rank, nth_element et les quantiles (mediane
+// glissante...) restent en O(h), sans reconstruire la fenetre.
+//
+// Des cles croissantes (dates, latences en hausse) arrivent toutes a
+// droite : sans re-equilibrage l'arbre deviendrait une liste. Il est donc
+// re-equilibre par bouc emissaire (RebalanceMode::Amortized) par defaut,
+// ce qui garde h en O(log(capacity)).
+//
+template <typename T, typename Stats = NoStats>
+class SlidingWindow
+{
+public:
+  using value_type = T;
+  using const_reference = const T&;
+  using clock = chrono::steady_clock;
+  using Tree = BinarySearchTree<T, Stats, true>;
+
+private:
+  struct Entry
+  {
+    value_type key;
+    clock::time_point stamp;
+  };
+
+  Tree _tree;
+  vector<Entry> _ring;
+  size_t _capacity;
+  size_t _oldest = 0;
+  size_t _size = 0;
+  clock::duration _horizon;
+
+public:
+  //
+  // @param capacity nombre maximal de cles dans la fenetre
+  // @param horizon age maximal d'une cle, illimite par defaut
+  // @param policy re-equilibrage de l'arbre des cles
+  // @exception std::invalid_argument si capacity est nul
+  explicit SlidingWindow(size_t capacity, 
+                         clock::duration horizon = clock::duration::max(),
+                         const RebalancePolicy& policy = 
+                           RebalancePolicy{ RebalanceMode::Amortized })
+  : _tree(policy), _capacity(capacity), _horizon(horizon)
+  {
+    if (capacity == 0) 
+    {
+      throw std::invalid_argument("invalid_argument_capacity");
+    }
+    _ring.reserve(capacity);
+  }
+
+  //
+  // @brief ajoute key, en evincant les cles trop anciennes et, si la
+  //        fenetre est pleine, la plus ancienne
+  //
+  // @remark Complexité en O(h) plus le nombre de cles expirees
+  void push(const_reference key, clock::time_point now = clock::now()) 
+  {
+    expire(now);
+    if (_size == _capacity) 
+    {
+      evict();
+    }
+    _tree.insert(key);
+    Entry e{ key, now };
+    size_t slot = (_oldest + _size) % _capacity;
+    if (slot == _ring.size()) 
+    {
+      _ring.push_back(std::move(e));
+    } 
+    else 
+    {
+      _ring[slot] = std::move(e);
+    }
+    ++_size;
+  }
+
+  //
+  // @brief evince les cles plus agees que horizon a la date now
+  //
+  // @return le nombre de cles evincees
+  size_t expire(clock::time_point now = clock::now()) 
+  {
+    if (_horizon == clock::duration::max()) 
+    {
+      return 0;
+    }
+    size_t evicted = 0;
+    while (_size and now - _ring[_oldest].stamp > _horizon) 
+    {
+      evict();
+      ++evicted;
+    }
+    return evicted;
+  }
+
+  //
+  // @brief retire la cle la plus ancienne
+  //
+  // @exception std::logic_error si la fenetre est vide
+  void pop() 
+  {
+    if (!_size) 
+    {
+      throw std::logic_error("logic_error_pop");
+    }
+    evict();
+  }
+
+  //
+  // @brief la cle la plus ancienne de la fenetre
+  //
+  // @exception std::logic_error si la fenetre est vide
+  const_reference oldest() const 
+  {
+    if (!_size) 
+    {
+      throw std::logic_error("logic_error_oldest");
+    }
+    return _ring[_oldest].key;
+  }
+
+  bool contains(const_reference key) const noexcept 
+  { 
+    return _tree.contains(key); 
+  }
+
+  size_t count(const_reference key) const noexcept 
+  { 
+    return _tree.count(key); 
+  }
+
+  size_t rank(const_reference key) const noexcept 
+  { 
+    return _tree.rank(key); 
+  }
+
+  const_reference nth_element(size_t n) const 
+  { 
+    return _tree.nth_element(n); 
+  }
+
+  const_reference quantile(double q) const 
+  { 
+    return _tree.quantile(q); 
+  }
+
+  template <typename Range>
+  vector<value_type> quantiles(const Range& qs) const 
+  { 
+    return _tree.quantiles(qs); 
+  }
+
+  vector<value_type> quantiles(initializer_list<double> qs) const 
+  { 
+    return _tree.quantiles(qs); 
+  }
+
+  //
+  // @brief mediane basse de la fenetre
+  //
+  const_reference median() const 
+  { 
+    return _tree.quantile(0.5); 
+  }
+
+  size_t size() const noexcept 
+  { 
+    return _size; 
+  }
+
+  bool empty() const noexcept 
+  { 
+    return !_size; 
+  }
+
+  size_t capacity() const noexcept 
+  { 
+    return _capacity; 
+  }
+
+  clock::duration horizon() const noexcept 
+  { 
+    return _horizon; 
+  }
+
+  //
+  // @brief l'arbre sous-jacent, pour shape_report, memory_usage...
+  //
+  const Tree& tree() const noexcept 
+  { 
+    return _tree; 
+  }
+
+  void clear() noexcept 
+  {
+    RebalancePolicy policy = _tree.rebalancePolicy();
+    _tree = Tree(policy);
+    _ring.clear();
+    _oldest = 0;
+    _size = 0;
+  }
+
+private:
+  // retire la cle la plus ancienne, retrouvee dans l'arbre par sa valeur
+  void evict() noexcept 
+  {
+    _tree.deleteElement(_ring[_oldest].key);
+    _oldest = (_oldest + 1) % _capacity;
+    --_size;
+  }
+};
+
+#ifdef BENCHMARK
+//
+// Banc de mesure des operations publiques de BinarySearchTree.
+//
+// Compiler avec -O2 -DBENCHMARK (cible "make bench"), puis
+//   LaboBinaryTree-bench [taille max]
+// Les tailles vont de 1K a la taille max (1M par defaut, 100M au plus).
+// Chaque operation est chronometree par lots; on rapporte ns/op, debit et
+// les percentiles de la duree par operation des lots.
+//
+//   LaboBinaryTree-bench --latency [taille]
+// donne les percentiles de latence par operation mesures par LatencyStats
+// (rdtsc), a cote de la forme de l'arbre mesure.
+//
+//   LaboBinaryTree-bench --pages [taille]
+// compare contains sur des cles aleatoires selon les pages des noeuds
+// (PageBacking), dans l'ordre d'insertion puis apres compact.
+//
+//   LaboBinaryTree-bench --simd [taille]
+// compare contains de l'arbre, une recherche dichotomique et la copie
+// figee (FrozenSnapshot) avec chaque jeu d'instructions disponible.
+//
+//   LaboBinaryTree-bench --branches [taille]
+// compare les descentes sans branchement des cles entieres a la descente
+// generale (meme arbre, cles emballees), avec les branchements et mauvaises
+// predictions par operation lus par perf_event_open quand la machine les
+// expose.
+//
+//   LaboBinaryTree-bench --strings [taille]
+// compare les descentes par prefixe des cles std::string a la descente
+// generale (memes chaines, emballees), sur des cles aux debuts varies puis
+// partageant un long prefixe commun.
+//
+//   LaboBinaryTree-bench --compare [taille max] [--json]
+// execute les memes charges sur BinarySearchTree (desequilibre, equilibre,
+// re-equilibre automatiquement et avec CountingStats), std::set, un vecteur
+// trie et un B-arbre et ecrit du CSV (ou du JSON).
+//
+#include <chrono>
+#include <random>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <malloc.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//
+// Comptabilite des allocations pour mesurer l'empreinte memoire : octets
+// demandes et octets reellement reserves par malloc, encore vivants.
+//
+namespace bench
+{
+  size_t liveRequested = 0;
+  size_t liveReserved = 0;
+}
+
+void* operator new(size_t n)
+{
+  void* p = malloc(n ? n : 1);
+  if (!p)
+    throw bad_alloc();
+  bench::liveRequested += n;
+  bench::liveReserved += malloc_usable_size(p);
+  return p;
+}
+
+void operator delete(void* p, size_t n) noexcept
+{
+  if (p)
+  {
+    bench::liveRequested -= n;
+    bench::liveReserved -= malloc_usable_size(p);
+    free(p);
+  }
+}
+
+void operator delete(void* p) noexcept
+{
+  // taille inconnue : on ne corrige que les octets reserves
+  if (p)
+  {
+    bench::liveReserved -= malloc_usable_size(p);
+    free(p);
+  }
+}
+
+// les blocs de noeuds de NodePool sont alignes : sans ces surcharges, ils
+// echapperaient aux comptes
+void* operator new(size_t n, align_val_t al)
+{
+  size_t a = size_t(al);
+  void* p = aligned_alloc(a, (std::max<size_t>(n, 1) + a - 1) / a * a);
+  if (!p)
+    throw bad_alloc();
+  bench::liveRequested += n;
+  bench::liveReserved += malloc_usable_size(p);
+  return p;
+}
+
+void operator delete(void* p, size_t n, align_val_t) noexcept
+{
+  if (p)
+  {
+    bench::liveRequested -= n;
+    bench::liveReserved -= malloc_usable_size(p);
+    free(p);
+  }
+}
+
+void operator delete(void* p, align_val_t) noexcept
+{
+  if (p)
+  {
+    bench::liveReserved -= malloc_usable_size(p);
+    free(p);
+  }
+}
+
+namespace bench
+{
+  using Clock = chrono::steady_clock;
+  using Key = int;
+  using Tree = BinarySearchTree<Key>;
+
+  enum class Distribution { Sorted, Reverse, Random, Zipf, Clustered };
+
+  const Distribution distributions[] = { Distribution::Sorted, 
+    Distribution::Reverse, Distribution::Random, Distribution::Zipf, 
+    Distribution::Clustered };
+
+  const char* name(Distribution d)
+  {
+    switch (d)
+    {
+      case Distribution::Sorted:    return "sorted";
+      case Distribution::Reverse:   return "reverse";
+      case Distribution::Random:    return "random";
+      case Distribution::Zipf:      return "zipf";
+      case Distribution::Clustered: return "clustered";
+    }
+    return "?";
+  }
+
   //
-  // @brief taille de l'arbre
+  // Au dela de cette taille, les distributions triees degenerent l'arbre en
+  // liste : insertion en O(n^2) et recursion de profondeur n. On les saute.
   //
-  // @return le nombre d'elements de l'arbre
-  // @remark Compexité en moyenne en O(1)
-  size_t size() const noexcept 
+  const size_t degenerateLimit = 10000;
+
+  bool degenerate(Distribution d)
   {
-      return _root->nbElements;
+    return d == Distribution::Sorted or d == Distribution::Reverse;
   }
-  
-  static size_t size(Node* r) noexcept 
-  { 
-      return r ? r->nbElements : 0;
-  }
-  //
-  // @brief cle en position n
+
   //
-  // @return une reference a la cle en position n par ordre croissant des
-  // elements
+  // @brief genere n cles selon la distribution d
   //
-  // @exception std::logic_error si nécessaire
+  // zipf et clustered produisent des doublons, que insert ignore.
   //
-  // ajoutez le code de gestion des exceptions, puis mettez en oeuvre
-  // la fonction recursive nth_element(Node*, n)
-  // @remark Compexité en O(n)
-  const_reference nth_element(size_t n) const 
+  vector<Key> generate(Distribution d, size_t n, mt19937_64& rng)
   {
-      if(n > size(_root)) 
+    vector<Key> keys(n);
+    switch (d)
+    {
+      case Distribution::Sorted:
+        for (size_t i = 0; i < n; ++i) keys[i] = Key(i);
+        break;
+      case Distribution::Reverse:
+        for (size_t i = 0; i < n; ++i) keys[i] = Key(n - 1 - i);
+        break;
+      case Distribution::Random:
+        for (size_t i = 0; i < n; ++i) keys[i] = Key(i);
+        shuffle(keys.begin(), keys.end(), rng);
+        break;
+      case Distribution::Zipf:
       {
-          throw std::logic_error("logic_error_nth_element");
+        // inversion de la loi continue de parametre s, puis dispersion des
+        // rangs pour que les cles populaires ne soient pas toutes petites
+        const double s = 0.99;
+        const double a = pow(double(n), 1 - s) - 1;
+        uniform_real_distribution<double> u(0, 1);
+        for (size_t i = 0; i < n; ++i)
+        {
+          size_t r = size_t(pow(u(rng) * a + 1, 1 / (1 - s))) % n;
+          keys[i] = Key((r * 2654435761u) % n);
+        }
+        break;
       }
-      return nth_element(_root,n);
+      case Distribution::Clustered:
+      {
+        // rafales de 64 cles consecutives a partir de bases aleatoires
+        uniform_int_distribution<size_t> base(0, n);
+        for (size_t i = 0; i < n; i += 64)
+        {
+          size_t b = base(rng);
+          for (size_t j = i; j < min(n, i + 64); ++j)
+            keys[j] = Key(b + j - i);
+        }
+        break;
+      }
+    }
+    return keys;
   }
-  
-private:
-  //
-  // @brief cle en position n dans un sous arbre
+
+  volatile size_t sink; // empeche l'elimination des resultats
+
+  struct Result
+  {
+    const char* op;
+    size_t ops;
+    double nsPerOp, p50, p90, p99, p999;
+  };
+
+  double percentile(vector<double>& v, double q)
+  {
+    size_t i = min(v.size() - 1, size_t(q * v.size()));
+    nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+  }
+
+  Result summarize(const char* op, size_t ops, double totalNs, 
+                   vector<double>& perOp)
+  {
+    Result r { op, ops, totalNs / ops, 0, 0, 0, 0 };
+    r.p50  = percentile(perOp, 0.50);
+    r.p90  = percentile(perOp, 0.90);
+    r.p99  = percentile(perOp, 0.99);
+    r.p999 = percentile(perOp, 0.999);
+    return r;
+  }
+
   //
-  // @param r la racine du sous arbre. ne peut pas etre nullptr
-  // @param n la position n
+  // @brief mesure fn(i) pour i dans [0, n), par lots d'au moins 16 appels
   //
-  // @return une reference a la cle en position n par ordre croissant des
-  // elements
-  // @remark Compexité en O(n)
-  static const_reference nth_element(Node* r, size_t n) noexcept 
+  template <typename Fn>
+  Result measure(const char* op, size_t n, Fn fn)
   {
-      if (r) 
-      {
-          size_t s = 0;
-          if (r->left) 
-          {
-              s = r->left->nbElements;
-          }
-          if (n < s) 
-          {
-              return nth_element(r->left, n);
-          } 
-          else if (n > s) 
-          {
-              return nth_element(r->right, n - s - 1);
-          } 
-          else 
-          {
-              return r->key;
-          }
-      }
-      return -1;
+    size_t batch = max<size_t>(16, n / 4096);
+    vector<double> perOp;
+    perOp.reserve(n / batch + 1);
+    double total = 0;
+    for (size_t i = 0; i < n; i += batch)
+    {
+      size_t end = min(n, i + batch);
+      auto t0 = Clock::now();
+      for (size_t j = i; j < end; ++j)
+        fn(j);
+      double ns = chrono::duration<double, nano>(Clock::now() - t0).count();
+      total += ns;
+      perOp.push_back(ns / (end - i));
+    }
+    return summarize(op, n, total, perOp);
   }
-  
-public:
-  //
-  // @brief position d'une cle dans l'ordre croissant des elements de l'arbre
+
   //
-  // @param key la cle dont on cherche le rang
+  // @brief mesure une operation sur tout l'arbre, repetee reps fois.
   //
-  // @return la position entre 0 et size()-1, size_t(-1) si la cle est absente
+  // setup() prepare chaque repetition hors chronometre. Les durees sont
+  // rapportees par element.
   //
-  // Ne pas modifier mais écrire la fonction
-  // récursive privée rank(Node*,const_reference)
-  // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
-  size_t rank(const_reference key) const noexcept 
+  template <typename Setup, typename Fn>
+  Result measureBulk(const char* op, size_t n, size_t reps, Setup setup, Fn fn)
   {
-        return rank(_root, key);
+    vector<double> perOp;
+    double total = 0;
+    for (size_t r = 0; r < reps; ++r)
+    {
+      setup();
+      auto t0 = Clock::now();
+      fn();
+      double ns = chrono::duration<double, nano>(Clock::now() - t0).count();
+      total += ns;
+      perOp.push_back(ns / n);
+    }
+    return summarize(op, n * reps, total, perOp);
   }
-  
-private:
+
+  void print(Distribution d, size_t n, const Result& r)
+  {
+    cout << left << setw(10) << name(d) << right << setw(10) << n << "  " 
+         << left << setw(14) << r.op << right << fixed << setprecision(1)
+         << setw(10) << r.nsPerOp << setw(10) << 1e3 / r.nsPerOp
+         << setw(10) << r.p50 << setw(10) << r.p90 
+         << setw(10) << r.p99 << setw(10) << r.p999 << endl;
+  }
+
+  void run(Distribution d, size_t n, mt19937_64& rng)
+  {
+    vector<Key> keys = generate(d, n, rng);
+    vector<Key> probes = keys;
+    shuffle(probes.begin(), probes.end(), rng);
+    vector<Result> results;
+
+    Tree tree;
+    results.push_back(measure("insert", n, [&](size_t i) { 
+      tree.insert(keys[i]); }));
+    size_t size = tree.size();
+    vector<size_t> positions(n);
+    for (size_t i = 0; i < n; ++i)
+      positions[i] = rng() % size;
+
+    results.push_back(measure("contains", n, [&](size_t i) { 
+      sink += tree.contains(probes[i]); }));
+    results.push_back(measure("rank", n, [&](size_t i) { 
+      sink += tree.rank(probes[i]); }));
+    results.push_back(measure("nth_element", n, [&](size_t i) { 
+      sink += size_t(tree.nth_element(positions[i])); }));
+    results.push_back(measure("min", n, [&](size_t) { 
+      sink += size_t(tree.min()); }));
+
+    results.push_back(measure("deleteElement", n, [&](size_t i) { 
+      sink += tree.deleteElement(probes[i]); }));
+    for (Key k : keys) tree.insert(k);
+    results.push_back(measure("deleteMin", size, [&](size_t) { 
+      tree.deleteMin(); }));
+    for (Key k : keys) tree.insert(k);
+
+    const size_t reps = max<size_t>(3, 100000 / n);
+    results.push_back(measureBulk("visitPre", size, reps, []{}, [&] { 
+      tree.visitPre([](Key k) { sink += size_t(k); }); }));
+    results.push_back(measureBulk("visitSym", size, reps, []{}, [&] { 
+      tree.visitSym([](Key k) { sink += size_t(k); }); }));
+    results.push_back(measureBulk("visitPost", size, reps, []{}, [&] { 
+      tree.visitPost([](Key k) { sink += size_t(k); }); }));
+
+    Tree copy;
+    results.push_back(measureBulk("copy", size, reps, 
+      [&] { copy = Tree(); }, 
+      [&] { Tree c(tree); copy = std::move(c); }));
+    results.push_back(measure("move", n, [&](size_t) { 
+      Tree m(std::move(tree)); tree = std::move(m); }));
+
+    results.push_back(measureBulk("linearize", size, reps, 
+      [&] { copy = tree; }, [&] { copy.linearize(); }));
+    results.push_back(measureBulk("balance", size, reps, 
+      [&] { copy = tree; }, [&] { copy.balance(); }));
+    results.push_back(measureBulk("compact", size, reps, 
+      [&] { copy = tree; }, [&] { copy.compact(); }));
+
+    // parcours et recherches sur un arbre equilibre dont les noeuds sont
+    // restes dans l'ordre d'insertion, puis sur le meme arbre compacte
+    copy = tree;
+    copy.balance();
+    results.push_back(measureBulk("visitSym-bal", size, reps, []{}, [&] { 
+      copy.visitSym([](Key k) { sink += size_t(k); }); }));
+    results.push_back(measure("contains-bal", n, [&](size_t i) { 
+      sink += copy.contains(probes[i]); }));
+    copy.compact();
+    results.push_back(measureBulk("visitSym-cmp", size, reps, []{}, [&] { 
+      copy.visitSym([](Key k) { sink += size_t(k); }); }));
+    results.push_back(measure("contains-cmp", n, [&](size_t i) { 
+      sink += copy.contains(probes[i]); }));
+
+    tree = Tree();
+    copy = Tree();
+    for (const Result& r : results)
+      print(d, n, r);
+  }
+
   //
-    // @brief position d'une cle dans l'ordre croissant des elements du sous-arbre
-    //
-    // @param key la cle dont on cherche le rang
-    // @param r la racine du sous arbre
-    //
-    // @return la position entre 0 et size()-1, size_t(-1) si la cle est absente
-    // @remark Complexité en O(h) où h est la hauteur de l’arbre, en moyenne O(log(n)), au pire O(n) si l’arbre est dégénéré
-    static size_t rank(Node* r, const_reference key) noexcept 
+  // @brief B+-arbre minimal servant de point de comparaison
+  //
+  // les cles sont dans les feuilles, les noeuds internes contiennent la plus
+  // petite cle de chaque enfant sauf le premier. La suppression retire la cle
+  // de sa feuille sans fusionner les noeuds sous-remplis.
+  //
+  template <typename K, size_t B = 32>
+  class BTree
+  {
+    struct Node
+    {
+      bool leaf;
+      size_t n = 0;           // nombre de cles
+      K keys[B];
+      Node* children[B + 1];  // n + 1 enfants si !leaf
+
+      explicit Node(bool leaf) : leaf(leaf) { }
+    };
+
+    Node* _root = new Node(true);
+
+    static void destroy(Node* r)
+    {
+      if (!r->leaf)
+        for (size_t i = 0; i <= r->n; ++i)
+          destroy(r->children[i]);
+      delete r;
+    }
+
+    // insere key sous r. Si r deborde, il est coupe en deux : la moitie
+    // droite est retournee et sep recoit sa plus petite cle.
+    static Node* insert(Node* r, const K& key, K& sep, bool& inserted)
     {
-        size_t nbElementCmp;
-        if (r) 
+      size_t i = upper_bound(r->keys, r->keys + r->n, key) - r->keys;
+      if (r->leaf)
+      {
+        if (i > 0 and !(r->keys[i - 1] < key))
+          return nullptr;
+        inserted = true;
+        if (r->n < B)
         {
-            size_t s = 0;
-            if (key < r->key) 
-            {
-                s = rank(r->left, key);
-                if (s != -1) 
-                {
-                    return s;
-                }
-            }
-            else if (key > r->key) 
-            {
-                s = rank(r->right, key);
-                if (s != -1) 
-                {
-                    if (!r->left) 
-                    {
-                        nbElementCmp = 0;
-                    }
-                    else 
-                    {
-                        nbElementCmp = r->left->nbElements;
-                    }
-                    return s + nbElementCmp + 1;
-                }
-            }
-            else 
-            {
-                if (!r->left) 
-                {
-                    nbElementCmp = 0;
-                }
-                else 
-                {
-                    nbElementCmp = r->left->nbElements;
-                }
-                return nbElementCmp;
-            }
-        } 
-        else 
+          copy_backward(r->keys + i, r->keys + r->n, r->keys + r->n + 1);
+          r->keys[i] = key;
+          r->n++;
+          return nullptr;
+        }
+      }
+      else
+      {
+        K childSep;
+        Node* split = insert(r->children[i], key, childSep, inserted);
+        if (!split)
+          return nullptr;
+        if (r->n < B)
         {
-            return -1;
+          copy_backward(r->keys + i, r->keys + r->n, r->keys + r->n + 1);
+          copy_backward(r->children + i + 1, r->children + r->n + 1, 
+                        r->children + r->n + 2);
+          r->keys[i] = childSep;
+          r->children[i + 1] = split;
+          r->n++;
+          return nullptr;
         }
-        return -1;
+        return splitInternal(r, i, childSep, split, sep);
+      }
+      return splitLeaf(r, i, key, sep);
     }
-    
-public:
-  //
-  // @brief linearise l'arbre
+
+    static Node* splitLeaf(Node* r, size_t i, const K& key, K& sep)
+    {
+      K all[B + 1];
+      copy(r->keys, r->keys + i, all);
+      all[i] = key;
+      copy(r->keys + i, r->keys + B, all + i + 1);
+      Node* right = new Node(true);
+      r->n = (B + 1) / 2;
+      right->n = B + 1 - r->n;
+      copy(all, all + r->n, r->keys);
+      copy(all + r->n, all + B + 1, right->keys);
+      sep = right->keys[0];
+      return right;
+    }
+
+    static Node* splitInternal(Node* r, size_t i, const K& key, Node* child, 
+                               K& sep)
+    {
+      K all[B + 1];
+      Node* kids[B + 2];
+      copy(r->keys, r->keys + i, all);
+      all[i] = key;
+      copy(r->keys + i, r->keys + B, all + i + 1);
+      copy(r->children, r->children + i + 1, kids);
+      kids[i + 1] = child;
+      copy(r->children + i + 1, r->children + B + 1, kids + i + 2);
+      Node* right = new Node(false);
+      r->n = B / 2;
+      right->n = B - r->n;
+      sep = all[r->n];
+      copy(all, all + r->n, r->keys);
+      copy(kids, kids + r->n + 1, r->children);
+      copy(all + r->n + 1, all + B + 1, right->keys);
+      copy(kids + r->n + 1, kids + B + 2, right->children);
+      return right;
+    }
+
+    Node* leafFor(const K& key) const
+    {
+      Node* r = _root;
+      while (!r->leaf)
+        r = r->children[upper_bound(r->keys, r->keys + r->n, key) - r->keys];
+      return r;
+    }
+
+  public:
+    BTree() = default;
+    BTree(const BTree&) = delete;
+    ~BTree() { destroy(_root); }
+
+    bool insert(const K& key)
+    {
+      K sep;
+      bool inserted = false;
+      Node* split = insert(_root, key, sep, inserted);
+      if (split)
+      {
+        Node* root = new Node(false);
+        root->n = 1;
+        root->keys[0] = sep;
+        root->children[0] = _root;
+        root->children[1] = split;
+        _root = root;
+      }
+      return inserted;
+    }
+
+    bool contains(const K& key) const
+    {
+      Node* r = leafFor(key);
+      return binary_search(r->keys, r->keys + r->n, key);
+    }
+
+    bool erase(const K& key)
+    {
+      Node* r = leafFor(key);
+      K* p = lower_bound(r->keys, r->keys + r->n, key);
+      if (p == r->keys + r->n or key < *p)
+        return false;
+      copy(p + 1, r->keys + r->n, p);
+      r->n--;
+      return true;
+    }
+  };
+
   //
-  // transforme l'arbre en une liste simplement chainee composee des memes
-  // noeuds que precedemment, mais dont les pointeurs left sont tous egaux
-  // a nullptr. Cette liste doit toujours respecter les conditions d'un
-  // arbre binaire de recherche
+  // Adaptateurs donnant la meme interface (build, contains, erase) aux
+  // structures comparees.
   //
-  // Ne pas modifier cette fonction qui sert essentiellement a tester la
-  // fonction recursive linearize(Node*, Node*&, size_t&) utilisée par
-  // la methode publique arborize
-  // @remark Complexité en O(n)
-  void linearize() noexcept 
+  template <typename Stats = NoStats>
+  struct BstAdapter
   {
-    size_t cnt = 0;
-    Node* list = nullptr;
-    linearize(_root,list,cnt);
-    _root = list;
-  }
-  
-private:
+    BinarySearchTree<Key, Stats> t;
+    bool balanced;
+    explicit BstAdapter(bool balanced, 
+                        RebalanceMode mode = RebalanceMode::Off) 
+    : t(RebalancePolicy { mode }), balanced(balanced) { }
+    void build(const vector<Key>& keys)
+    {
+      for (Key k : keys) t.insert(k);
+      if (balanced) t.balance();
+    }
+    bool contains(Key k) const { return t.contains(k); }
+    bool erase(Key k) { return t.deleteElement(k); }
+  };
+
+  struct SetAdapter
+  {
+    set<Key> t;
+    void build(const vector<Key>& keys) { for (Key k : keys) t.insert(k); }
+    bool contains(Key k) const { return t.count(k); }
+    bool erase(Key k) { return t.erase(k); }
+  };
+
   //
-  // @brief linearise une sous arbre tree en une liste
+  // le vecteur trie est construit en bloc (tri puis unique). Ses
+  // suppressions coutent O(n) chacune : on les saute au dela de
+  // vectorEraseLimit cles.
   //
-  // @param tree pointe vers la racine de l'arbre a lineariser
-  // @param list reference a la tete de la liste a creer. sera modifiee
-  //             par la fonction pour que list pointe vers le plus petit
-  //             element de tree
-  // @param cnt  calcule au fure et a mesure le nombre d'elements de la liste
-  //             cree. l'effet de la fonction doit etre d'ajouter le nombre
-  //             d'elements du sous-arbre de racine tree. Cependant, vous
-  //             avez uniquement le droit d'utiliser l'opérateur ++.
-  // @remark Compexité en O(n)
-  static void linearize(Node* tree, Node*& list, size_t& cnt) noexcept 
+  const size_t vectorEraseLimit = 100000;
+
+  struct VectorAdapter
+  {
+    vector<Key> t;
+    void build(const vector<Key>& keys)
+    {
+      t = keys;
+      sort(t.begin(), t.end());
+      t.erase(unique(t.begin(), t.end()), t.end());
+      t.shrink_to_fit();
+    }
+    bool contains(Key k) const { return binary_search(t.begin(), t.end(), k); }
+    bool erase(Key k)
+    {
+      auto it = lower_bound(t.begin(), t.end(), k);
+      if (it == t.end() or *it != k)
+        return false;
+      t.erase(it);
+      return true;
+    }
+  };
+
+  struct BTreeAdapter
   {
-      // Parcours symétrique inverse pour les mettre dans une liste
-      // sans oublier de mettre l'élément de gauche à nul sous peine
-      // de créer une boucle infinie
-      if(tree)
-      {
-          linearize(tree->right, list, cnt); // on va à l'élément plus à droite
-          tree->right = list; // sauve la liste dans l'élément suivant
-          list = tree; // affecte l'arbre courant à la liste
-          cnt++; 
-          list->nbElements = cnt; // nbElement s'incrémente vu qu'on vient de relier un nouveau noeud
-          linearize(tree->left, list, cnt);
-          tree->left = nullptr; // on détache à gauche
-      }
-  }
-  
-  
-public:
+    BTree<Key> t;
+    void build(const vector<Key>& keys) { for (Key k : keys) t.insert(k); }
+    bool contains(Key k) const { return t.contains(k); }
+    bool erase(Key k) { return t.erase(k); }
+  };
+
+  struct Row
+  {
+    const char* structure;
+    const char* distribution;
+    size_t n;
+    const char* op;
+    double nsPerOp;
+    size_t bytes;       // octets reserves apres construction, 0 sinon
+    size_t distinct;    // nombre de cles distinctes
+  };
+
   //
-  // @brief equilibre l'arbre
+  // @brief execute la charge commune sur une structure
   //
-  // applique l'algorithme d'equilibrage de l'arbre par linearisation et
-  // arborisation
+  // build de toutes les cles, recherches presentes puis absentes, et
+  // suppression de toutes les cles dans un ordre aleatoire.
   //
-  // Ne pas modifier cette fonction.
-  // @remark Complexité O(n)
-  void balance() noexcept 
+  template <typename Adapter>
+  void compare(const char* structure, Adapter adapter, Distribution d, 
+               const vector<Key>& keys, const vector<Key>& hits, 
+               const vector<Key>& misses, vector<Row>& rows)
   {
-    size_t cnt = 0;
-    Node* list = nullptr;
-    linearize(_root,list,cnt);
-    arborize(_root,list,cnt);
+    size_t n = keys.size();
+    size_t before = liveReserved;
+    auto t0 = Clock::now();
+    adapter.build(keys);
+    double ns = chrono::duration<double, nano>(Clock::now() - t0).count();
+    size_t bytes = liveReserved - before;
+    size_t distinct = 0;
+    for (Key k : hits)
+      distinct += adapter.contains(k);
+    rows.push_back({ structure, name(d), n, "build", ns / n, bytes, 
+                     distinct });
+
+    Result r = measure("contains_hit", n, [&](size_t i) { 
+      sink += adapter.contains(hits[i]); });
+    rows.push_back({ structure, name(d), n, r.op, r.nsPerOp, 0, distinct });
+    r = measure("contains_miss", n, [&](size_t i) { 
+      sink += adapter.contains(misses[i]); });
+    rows.push_back({ structure, name(d), n, r.op, r.nsPerOp, 0, distinct });
+    if (is_same<Adapter, VectorAdapter>::value and n > vectorEraseLimit)
+      return;
+    r = measure("erase", n, [&](size_t i) { 
+      sink += adapter.erase(hits[i]); });
+    rows.push_back({ structure, name(d), n, r.op, r.nsPerOp, 0, distinct });
   }
-  
-private:
-  //
-  // @brief arborise les cnt premiers elements d'une liste en un arbre
-  //
-  // @param tree reference dans laquelle il faut ecrire la racine de l'arbre
-  //             arborise par la fonction
-  // @param list IN - reference a la tete de la liste a parcourir. La liste
-  //                  est composee de Node dont le pointer left est nullptr
-  //             OUT - debut de la suite de la liste dont on a utilise cnt
-  //                   elements
-  // @param cnt  nombre d'elements de la liste que l'on doit utiliser pour
-  //             arboriser le sous arbre
-  // @remark Complexité O(n)
-    static void arborize(Node *& tree, Node *& list, size_t cnt) noexcept 
+
+  void writeCsv(const vector<Row>& rows)
+  {
+    cout << "structure,distribution,n,op,ns_per_op,mops_per_s,bytes,"
+            "bytes_per_key" << endl;
+    for (const Row& r : rows)
     {
-        Node *subTreeR;
-        Node *subTreeL; 
-        if (cnt > 0)
+      cout << r.structure << ',' << r.distribution << ',' << r.n << ',' 
+           << r.op << ',' << fixed << setprecision(2) << r.nsPerOp << ',' 
+           << 1e3 / r.nsPerOp << ',' << r.bytes << ',' 
+           << double(r.bytes) / r.distinct << endl;
+    }
+  }
+
+  void writeJson(const vector<Row>& rows)
+  {
+    cout << "[" << endl;
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+      const Row& r = rows[i];
+      cout << "  {\"structure\": \"" << r.structure << "\", \"distribution\": \""
+           << r.distribution << "\", \"n\": " << r.n << ", \"op\": \"" << r.op 
+           << "\", \"ns_per_op\": " << fixed << setprecision(2) << r.nsPerOp 
+           << ", \"mops_per_s\": " << 1e3 / r.nsPerOp << ", \"bytes\": " 
+           << r.bytes << ", \"bytes_per_key\": " 
+           << double(r.bytes) / r.distinct << "}" 
+           << (i + 1 < rows.size() ? "," : "") << endl;
+    }
+    cout << "]" << endl;
+  }
+
+  int compare(size_t maxSize, bool json, mt19937_64& rng)
+  {
+    vector<Row> rows;
+    for (size_t n = 1000; n <= min<size_t>(maxSize, 100000000); n *= 10)
+    {
+      for (Distribution d : distributions)
+      {
+        // cles paires presentes, cles impaires absentes
+        vector<Key> keys = generate(d, n, rng);
+        vector<Key> misses(n);
+        for (size_t i = 0; i < n; ++i)
         {
-            size_t cntL = (cnt - 1) / 2; // pour compteur pour le s-a gauche
-            size_t cntR = cnt - cntL - 1; // pour compteur pour le s-a droite
-            arborize(subTreeL, list, cntL); 
-            tree = list; 
-            list = list->right;
-            arborize(subTreeR, list, cntR); 
-            tree->nbElements = cntL + cntR + 1; // + 2 à cause du --cnt
-            tree->right = subTreeR;
-            tree->left = subTreeL; 
-        } 
-        else 
+          keys[i] *= 2;
+          misses[i] = keys[i] + 1;
+        }
+        vector<Key> hits = keys;
+        shuffle(hits.begin(), hits.end(), rng);
+        shuffle(misses.begin(), misses.end(), rng);
+
+        if (!degenerate(d) or n <= degenerateLimit)
         {
-            tree = nullptr;
+          compare("bst", BstAdapter<>(false), d, keys, hits, misses, rows);
+          compare("bst-balanced", BstAdapter<>(true), d, keys, hits, misses, 
+                  rows);
+          compare("bst-inline", BstAdapter<>(false, RebalanceMode::Inline), 
+                  d, keys, hits, misses, rows);
+          compare("bst-stats", BstAdapter<CountingStats>(false), d, keys, 
+                  hits, misses, rows);
         }
+        // les reconstructions de boucs emissaires bornent la profondeur,
+        // meme sur des cles triees
+        compare("bst-amortized", BstAdapter<>(false, RebalanceMode::Amortized), 
+                d, keys, hits, misses, rows);
+        compare("std::set", SetAdapter(), d, keys, hits, misses, rows);
+        compare("sorted-vector", VectorAdapter(), d, keys, hits, misses, rows);
+        compare("btree", BTreeAdapter(), d, keys, hits, misses, rows);
+      }
     }
-  
-public:
+    if (json)
+      writeJson(rows);
+    else
+      writeCsv(rows);
+    return EXIT_SUCCESS;
+  }
+
   //
-  // @brief Parcours pre-ordonne de l'arbre
+  // @brief percentiles de latence par operation, avec LatencyStats
   //
-  // @param f une fonction capable d'être appelée en recevant une cle
-  //          en parametre. Pour le noeud n courrant, l'appel sera
-  //          f(n->key);
-  // @remark Compexité en moyenne en O(n)
-  template <typename Fn>
-  void visitPre (Fn f) 
-  {
-      if(_root != nullptr)
-      {
-          parcoursPreOrdonne(_root, f);
-      }
-  }
-  
-  template<typename Fn>
-  void parcoursPreOrdonne(Node *leaf, Fn f)
+  int latency(size_t n, mt19937_64& rng)
   {
-      f(leaf->key);
-
-      if(leaf->left != nullptr)
+    using Timed = BinarySearchTree<Key, LatencyStats<>>;
+    const TreeOp ops[] = { TreeOp::Insert, TreeOp::Contains, TreeOp::Rank, 
+                           TreeOp::NthElement, TreeOp::DeleteElement };
+    cout << left << setw(10) << "dist" << right << setw(10) << "n" << "  " 
+         << left << setw(14) << "op" << right << setw(10) << "count" 
+         << setw(10) << "p50" << setw(10) << "p99" << setw(10) << "p999" 
+         << setw(10) << "height" << setw(8) << "ratio" << endl;
+    for (Distribution d : { Distribution::Random, Distribution::Zipf, 
+                            Distribution::Clustered })
+    {
+      vector<Key> keys = generate(d, n, rng);
+      vector<Key> probes = keys;
+      shuffle(probes.begin(), probes.end(), rng);
+      ShapeReport shape;
       {
-          parcoursPreOrdonne(leaf->left, f);
+        Timed t;
+        for (Key k : keys) t.insert(k);
+        shape = t.shape_report();
+        for (Key k : probes) sink += t.contains(k);
+        for (Key k : probes) sink += t.rank(k);
+        for (size_t i = 0; i < n; ++i) 
+          sink += size_t(t.nth_element(rng() % t.size()));
+        for (size_t i = 0; i < n / 2; ++i) sink += t.deleteElement(probes[i]);
       }
-      
-      if(leaf->right != nullptr)
+      for (TreeOp op : ops)
       {
-          parcoursPreOrdonne(leaf->right, f);
+        LatencyHistogram h = LatencyStats<>::latency(op);
+        cout << left << setw(10) << name(d) << right << setw(10) << n << "  " 
+             << left << setw(14) << name(op) << right << setw(10) << h.count() 
+             << fixed << setprecision(1) << setw(10) << h.percentile(0.5) 
+             << setw(10) << h.percentile(0.99) << setw(10) 
+             << h.percentile(0.999) << setw(10) << shape.height << setw(8) 
+             << setprecision(2) << shape.heightRatio << endl;
       }
+      LatencyStats<>::resetLatency();
+    }
+    return EXIT_SUCCESS;
   }
-  
+
   //
-  // @brief Parcours symétrique de l'arbre
+  // @brief contains aleatoire selon les pages des noeuds
   //
-  // @param f une fonction capable d'être appelée en recevant une cle
-  //          en parametre. Pour le noeud n courrant, l'appel sera
-  //          f(n->key);
-  // @remark Compexité en moyenne en O(n)
-  template <typename Fn>
-  void visitSym (Fn f) 
+  int pages(size_t n, mt19937_64& rng)
   {
-      if(_root != nullptr)
-      {
-          parcoursSymetrique(_root, f);
-      }
+    vector<Key> keys = generate(Distribution::Random, n, rng);
+    vector<Key> probes = keys;
+    shuffle(probes.begin(), probes.end(), rng);
+    cout << left << setw(10) << "backing" << right << setw(10) << "n" << "  " 
+         << left << setw(14) << "op" << right << setw(10) << "ns/op" 
+         << setw(10) << "p50" << setw(10) << "p99" << setw(12) << "advisedMB" 
+         << endl;
+    for (PageBacking b : { PageBacking::Default, PageBacking::TransparentHuge,
+                           PageBacking::ExplicitHuge })
+    {
+      Tree tree;
+      tree.setPageBacking(b);
+      for (Key k : keys) tree.insert(k);
+      auto report = [&](const Result& r) {
+        cout << left << setw(10) << name(b) << right << setw(10) << n << "  " 
+             << left << setw(14) << r.op << right << fixed << setprecision(1)
+             << setw(10) << r.nsPerOp << setw(10) << r.p50 << setw(10) 
+             << r.p99 << setw(12) 
+             << tree.memory_usage().hugePageAdvisedBytes / double(1 << 20) 
+             << endl;
+      };
+      report(measure("contains", n, [&](size_t i) { 
+        sink += tree.contains(probes[i]); }));
+      tree.compact(CompactOrder::BreadthFirst);
+      report(measure("contains-cmp", n, [&](size_t i) { 
+        sink += tree.contains(probes[i]); }));
+    }
+    return EXIT_SUCCESS;
   }
-  
-  template <typename Fn>
-  void parcoursSymetrique(Node *leaf, Fn f)
+
+  //
+  // @brief recherches dans la copie figee, selon le jeu d'instructions
+  //
+  int simd(size_t n, mt19937_64& rng)
   {
-      if(leaf->left != nullptr)
-      {
-          parcoursSymetrique(leaf->left, f);
-      }
-     
-      f(leaf->key);
-      
-      if(leaf->right != nullptr)
-      {
-          parcoursSymetrique(leaf->right, f);
-      }
+    vector<Key> keys = generate(Distribution::Random, n, rng);
+    vector<Key> probes = keys;
+    shuffle(probes.begin(), probes.end(), rng);
+    // moitie de cles absentes : les recherches echouent aussi
+    for (size_t i = 0; i < n; i += 2) probes[i] = Key(rng());
+    Tree tree;
+    for (Key k : keys) tree.insert(k);
+    tree.balance();
+    FrozenSnapshot<Key> frozen = tree.freeze();
+    vector<Key> sorted = keys;
+    sort(sorted.begin(), sorted.end());
+
+    cout << left << setw(10) << "search" << right << setw(10) << "n" << "  " 
+         << left << setw(14) << "op" << right << setw(10) << "ns/op" 
+         << setw(10) << "Mops/s" << setw(10) << "p50" << setw(10) << "p99" 
+         << endl;
+    auto report = [&](const char* search, const Result& r) {
+      cout << left << setw(10) << search << right << setw(10) << n << "  " 
+           << left << setw(14) << r.op << right << fixed << setprecision(1)
+           << setw(10) << r.nsPerOp << setw(10) << 1e3 / r.nsPerOp 
+           << setw(10) << r.p50 << setw(10) << r.p99 << endl;
+    };
+    report("tree-bal", measure("contains", n, [&](size_t i) { 
+      sink += tree.contains(probes[i]); }));
+    report("binary", measure("lower_bound", n, [&](size_t i) { 
+      sink += lower_bound(sorted.begin(), sorted.end(), probes[i]) 
+              - sorted.begin(); }));
+    for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::Avx2, 
+                             SimdLevel::Avx512 })
+    {
+      if (FrozenSnapshot<Key>::setSimdLevel(level) != level)
+        continue;
+      report(name(level), measure("lower_bound", n, [&](size_t i) { 
+        sink += frozen.lower_bound(probes[i]); }));
+      report(name(level), measure("contains", n, [&](size_t i) { 
+        sink += frozen.contains(probes[i]); }));
+      report(name(level), measure("rank", n, [&](size_t i) { 
+        sink += frozen.rank(probes[i]); }));
+    }
+    FrozenSnapshot<Key>::setSimdLevel(detectSimd());
+    return EXIT_SUCCESS;
   }
-  
+
   //
-  // @brief Parcours post-ordonne de l'arbre
+  // @brief branchements et mauvaises predictions du thread courant
   //
-  // @param f une fonction capable d'être appelée en recevant une cle
-  //          en parametre. Pour le noeud n courrant, l'appel sera
-  //          f(n->key);
-  // @remark Compexité en moyenne en O(n)
-  template < typename Fn >
-  void visitPost (Fn f) 
+  // lus par perf_event_open. Hors Linux, sans PMU (machine virtuelle) ou
+  // si perf_event_paranoid l'interdit, available() est faux.
+  //
+  class PerfCounters
   {
-      if(_root != nullptr)
+    int fd[2] = { -1, -1 }; // branchements, mauvaises predictions
+
+  public:
+    PerfCounters()
+    {
+#ifdef __linux__
+      const uint64_t events[2] = { PERF_COUNT_HW_BRANCH_INSTRUCTIONS, 
+                                   PERF_COUNT_HW_BRANCH_MISSES };
+      for (int i = 0; i < 2; ++i)
       {
-          parcoursPostOrdonne(_root, f);
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = events[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
       }
-  }
-  
-  template<typename Fn>
-  void parcoursPostOrdonne(Node *leaf, Fn f)
-  {
-      if(leaf->left != nullptr)
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+      for (int f : fd)
+        if (f >= 0)
+          close(f);
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const 
+    { 
+      return fd[0] >= 0 and fd[1] >= 0; 
+    }
+
+    void start()
+    {
+#ifdef __linux__
+      for (int f : fd)
       {
-          parcoursPostOrdonne(leaf->left, f);
+        if (f >= 0)
+        {
+          ioctl(f, PERF_EVENT_IOC_RESET, 0);
+          ioctl(f, PERF_EVENT_IOC_ENABLE, 0);
+        }
       }
-      
-      if(leaf->right != nullptr)
+#endif
+    }
+
+    // branchements et mauvaises predictions depuis start()
+    array<uint64_t, 2> stop()
+    {
+      array<uint64_t, 2> counts = { 0, 0 };
+#ifdef __linux__
+      for (int i = 0; i < 2; ++i)
       {
-          parcoursPostOrdonne(leaf->right, f);
+        if (fd[i] >= 0)
+        {
+          ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+          if (read(fd[i], &counts[i], sizeof counts[i]) != sizeof counts[i])
+            counts[i] = 0;
+        }
       }
-      
-      f(leaf->key);
-  }
-  
-  
+#endif
+      return counts;
+    }
+  };
+
+  // cle non entiere : force la descente generale a deux comparaisons
+  struct BoxedKey
+  {
+    Key v;
+    bool operator<(const BoxedKey& o) const { return v < o.v; }
+    bool operator>(const BoxedKey& o) const { return v > o.v; }
+  };
+
   //
-  // Les fonctions suivantes sont fournies pour permettre de tester votre classe
-  // Merci de ne rien modifier au dela de cette ligne
+  // @brief descentes sans branchement contre descente generale
   //
-  void display() const 
+  int branches(size_t n, mt19937_64& rng)
   {
-    stringstream ss1, ss2, ss3;
-    displayKeys(ss1);
-    displayKeys(ss3);
-    displayCounts(ss2);
-    string l1, l2;
-    
-    size_t W = 11;
-    while( getline(ss3,l1))
-      if (l1.length() > W) W = l1.length();
+    vector<Key> keys = generate(Distribution::Random, n, rng);
+    vector<Key> probes = keys;
+    shuffle(probes.begin(), probes.end(), rng);
+    PerfCounters counters;
+    cout << left << setw(10) << "descent" << right << setw(10) << "n" << "  " 
+         << left << setw(14) << "op" << right << setw(10) << "ns/op" 
+         << setw(12) << "branches" << setw(12) << "misses" << endl;
 
-    displayKeys(ss1);
-    
-    cout << "\n";
-    cout << "+-" << left << setfill('-') << setw(W) << "-" << "+-" << setw(W) << "-" << setfill(' ') << "+" << endl;
-    cout << "| "<< left << setw(W) << "key" << "| " << setw(W) << "nbElements" << "|" << endl;
-    cout << "+-" << left << setfill('-') << setw(W) << "-" << "+-" << setw(W) << "-" << setfill(' ') << "+" << endl;
-    while( getline(ss1,l1) and getline(ss2, l2) ) {
-      cout << "| "<< left << setw(W) << l1 << "| " << setw(W) << l2 << "|" << endl;
+    auto time = [&](const char* descent, const char* op, size_t ops, auto fn) {
+      counters.start();
+      auto t0 = Clock::now();
+      for (size_t i = 0; i < ops; ++i)
+        fn(i);
+      double ns = chrono::duration<double, nano>(Clock::now() - t0).count();
+      array<uint64_t, 2> c = counters.stop();
+      cout << left << setw(10) << descent << right << setw(10) << n << "  " 
+           << left << setw(14) << op << right << fixed << setprecision(1) 
+           << setw(10) << ns / ops;
+      if (counters.available())
+        cout << setw(12) << double(c[0]) / ops << setw(12) << double(c[1]) / ops;
+      else
+        cout << setw(12) << "n/a" << setw(12) << "n/a";
+      cout << endl;
+    };
+
+    {
+      Tree t;
+      time("branchless", "insert", n, [&](size_t i) { t.insert(keys[i]); });
+      time("branchless", "contains", n, [&](size_t i) { 
+        sink += t.contains(probes[i]); });
+      time("branchless", "rank", n, [&](size_t i) { 
+        sink += t.rank(probes[i]); });
+      time("branchless", "deleteElement", n / 2, [&](size_t i) { 
+        sink += t.deleteElement(probes[i]); });
     }
-    cout << "+-" << left << setfill('-') << setw(W) << "-" << "+-" << setw(W) << "-" << setfill(' ') << "+" << endl;
-  }
-  
-  void displayKeys(ostream& os = cout) const 
-  {
-    display([](Node* n) -> const_reference { return n->key; }, os);
+    {
+      BinarySearchTree<BoxedKey> t;
+      time("generic", "insert", n, [&](size_t i) { t.insert({ keys[i] }); });
+      time("generic", "contains", n, [&](size_t i) { 
+        sink += t.contains({ probes[i] }); });
+      time("generic", "rank", n, [&](size_t i) { 
+        sink += t.rank({ probes[i] }); });
+      time("generic", "deleteElement", n / 2, [&](size_t i) { 
+        sink += t.deleteElement({ probes[i] }); });
+    }
+    return EXIT_SUCCESS;
   }
-  
-  void displayCounts(ostream& os = cout) const 
+
+  // chaine non std::string : force la descente generale
+  struct BoxedString
   {
-    display([](Node* n) -> size_t { return n->nbElements; }, os);
-  }
-  
+    string s;
+    bool operator<(const BoxedString& o) const { return s < o.s; }
+    bool operator>(const BoxedString& o) const { return s > o.s; }
+  };
+
   //
-  // utilise un parcours de l'arbre en largeur avec
-  // un noeud sentinelle newLevel qui traque les
-  // changements de niveaux
+  // @brief descentes par prefixe contre descente generale, cles chaines
   //
-  template <typename Fn>
-  void display (Fn func, ostream& os = cout ) const 
+  int strings(size_t n, mt19937_64& rng)
   {
-    Node* newLevel = (Node*) -1;
-    // addresse non nulle dont on est sur qu'elle ne contient pas
-    // vraiment un Node. Utilisée comme sentinelle.
-    
-    queue<Node*> Q;
-    Q.push(_root);
-    Q.push(newLevel);
-    
-    while(!Q.empty()) {
-      Node* cur = Q.front();
-      Q.pop();
-      
-      if(cur == newLevel) {
-        os << endl;
-        if(!Q.empty())
-          Q.push(newLevel);
-      } else if(cur == nullptr) {
-        os << "- ";
-      } else {
-        os << func(cur) << " ";
-        Q.push(cur->left);
-        Q.push(cur->right);
+    cout << left << setw(10) << "keys" << right << setw(10) << "n" << "  " 
+         << left << setw(14) << "op" << right << setw(10) << "prefix" 
+         << setw(10) << "generic" << endl;
+    for (const char* shape : { "varied", "shared" })
+    {
+      // identifiants de 20 caracteres, eventuellement apres un prefixe
+      // commun qui rend les prefixes des noeuds inutiles
+      string head = shape == string("shared") ? "tenant/0001/item/" : "";
+      vector<string> keys(n);
+      for (string& k : keys)
+      {
+        k = head;
+        for (int i = 0; i < 20; ++i)
+          k += char('a' + rng() % 26);
       }
+      vector<string> probes = keys;
+      shuffle(probes.begin(), probes.end(), rng);
+
+      BinarySearchTree<string> fast;
+      BinarySearchTree<BoxedString> slow;
+      auto row = [&](const char* op, auto f, auto g) {
+        Result a = measure(op, n, f);
+        Result b = measure(op, n, g);
+        cout << left << setw(10) << shape << right << setw(10) << n << "  " 
+             << left << setw(14) << op << right << fixed << setprecision(1) 
+             << setw(10) << a.nsPerOp << setw(10) << b.nsPerOp << endl;
+      };
+      row("insert", [&](size_t i) { fast.insert(keys[i]); }, 
+                    [&](size_t i) { slow.insert({ keys[i] }); });
+      row("contains", [&](size_t i) { sink += fast.contains(probes[i]); }, 
+                      [&](size_t i) { sink += slow.contains({ probes[i] }); });
+      row("rank", [&](size_t i) { sink += fast.rank(probes[i]); }, 
+                  [&](size_t i) { sink += slow.rank({ probes[i] }); });
     }
+    return EXIT_SUCCESS;
   }
-};
 
+  int run(int argc, char* argv[])
+  {
+    vector<string> args(argv + 1, argv + argc);
+    bool comparative = find(args.begin(), args.end(), "--compare") != args.end();
+    bool latencies = find(args.begin(), args.end(), "--latency") != args.end();
+    bool paged = find(args.begin(), args.end(), "--pages") != args.end();
+    bool vectorized = find(args.begin(), args.end(), "--simd") != args.end();
+    bool branchy = find(args.begin(), args.end(), "--branches") != args.end();
+    bool texts = find(args.begin(), args.end(), "--strings") != args.end();
+    bool json = find(args.begin(), args.end(), "--json") != args.end();
+    size_t maxSize = 1000000;
+    for (const string& a : args)
+      if (!a.empty() and isdigit(a[0]))
+        maxSize = stoull(a);
+    mt19937_64 rng(42);
+    if (comparative)
+      return compare(maxSize, json, rng);
+    if (latencies)
+      return latency(maxSize, rng);
+    if (paged)
+      return pages(maxSize, rng);
+    if (vectorized)
+      return simd(maxSize, rng);
+    if (branchy)
+      return branches(maxSize, rng);
+    if (texts)
+      return strings(maxSize, rng);
+
+    cout << left << setw(10) << "dist" << right << setw(10) << "n" << "  " 
+         << left << setw(14) << "op" << right << setw(10) << "ns/op" 
+         << setw(10) << "Mops/s" << setw(10) << "p50" << setw(10) << "p90" 
+         << setw(10) << "p99" << setw(10) << "p999" << endl;
+    for (size_t n = 1000; n <= min<size_t>(maxSize, 100000000); n *= 10)
+    {
+      for (Distribution d : distributions)
+      {
+        if (degenerate(d) and n > degenerateLimit)
+          continue;
+        run(d, n, rng);
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+    return bench::run(argc, argv);
+}
+#else
 int main()
 {
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file